@@ -41,7 +41,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #include <lib/datewidget.h>
 #include <lib/mimetypeutils.h>
 #include <lib/semanticinfo/sorteddirmodel.h>
-#include <lib/timeutils.h>
 #include <semanticinfo/semanticinfodirmodel.h>
 
 #ifndef GWENVIEW_SEMANTICINFO_BACKEND_NONE
@@ -199,8 +198,7 @@ public:
         if (!mDate.isValid()) {
             return true;
         }
-        KFileItem fileItem = model()->itemForSourceIndex(index);
-        QDate date = TimeUtils::dateTimeForFileItem(fileItem).date();
+        QDate date = model()->dateTimeForSourceIndex(index).date();
         switch (mMode) {
         case GreaterOrEqual:
             return date >= mDate;
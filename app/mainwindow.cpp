@@ -1978,29 +1978,47 @@ void MainWindow::preloadNextUrl()
         return;
     }
 
-    QModelIndex index = indexList.at(0);
-    if (!index.isValid()) {
+    const QModelIndex currentIndex = indexList.at(0);
+    if (!currentIndex.isValid()) {
         return;
     }
 
+    // Collect the indexes the user is likely to visit next, most likely first
+    QModelIndexList indexes;
     if (d->mCurrentMainPageId == ViewMainPageId) {
-        // If we are in view mode, preload the next url, otherwise preload the
-        // selected one
-        int offset = d->mPreloadDirectionIsForward ? 1 : -1;
-        index = d->mDirModel->sibling(index.row() + offset, index.column(), index);
-        if (!index.isValid()) {
-            return;
+        // If we are in view mode, preload the images around the current one,
+        // alternating between both directions but favoring the one the user
+        // is browsing in. Otherwise preload the selected one.
+        const int forwardCount = GwenviewConfig::preloadForwardCount();
+        const int backwardCount = GwenviewConfig::preloadBackwardCount();
+        const int direction = d->mPreloadDirectionIsForward ? 1 : -1;
+        for (int distance = 1; distance <= qMax(forwardCount, backwardCount); ++distance) {
+            if (distance <= forwardCount) {
+                indexes << d->mDirModel->sibling(currentIndex.row() + distance * direction, currentIndex.column(), currentIndex);
+            }
+            if (distance <= backwardCount) {
+                indexes << d->mDirModel->sibling(currentIndex.row() - distance * direction, currentIndex.column(), currentIndex);
+            }
         }
+    } else {
+        indexes << currentIndex;
     }
 
-    KFileItem item = d->mDirModel->itemForIndex(index);
-    if (!ArchiveUtils::fileItemIsDirOrArchive(item)) {
-        QUrl url = item.url();
-        if (url.isLocalFile()) {
-            QSize size = d->mViewStackedWidget->size();
-            d->mPreloader->preload(url, size);
+    QList<QUrl> urls;
+    for (const QModelIndex &index : qAsConst(indexes)) {
+        if (!index.isValid()) {
+            continue;
+        }
+        KFileItem item = d->mDirModel->itemForIndex(index);
+        if (!ArchiveUtils::fileItemIsDirOrArchive(item)) {
+            QUrl url = item.url();
+            if (url.isLocalFile()) {
+                urls << url;
+            }
         }
     }
+    QSize size = d->mViewStackedWidget->size();
+    d->mPreloader->preload(urls, size);
 }
 
 // Set a sane initial window size
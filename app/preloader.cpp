@@ -21,6 +21,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 // Self
 #include "preloader.h"
 
+// STL
+#include <algorithm>
+
 // Qt
 
 // KF
@@ -42,15 +45,62 @@ namespace Gwenview
 
 struct PreloaderPrivate {
     Preloader *q = nullptr;
-    Document::Ptr mDocument;
     QSize mSize;
 
-    void forgetDocument()
+    // Documents of the preload window. We keep a reference to them so that
+    // DocumentFactory does not evict them while we preload the next ones.
+    QList<Document::Ptr> mDocuments;
+
+    // Urls of the window which have not been preloaded yet, most likely first
+    QList<QUrl> mPendingUrls;
+
+    // Document being preloaded
+    Document::Ptr mCurrentDocument;
+
+    void forgetCurrentDocument()
+    {
+        if (!mCurrentDocument) {
+            return;
+        }
+        QObject::disconnect(mCurrentDocument.data(), nullptr, q, nullptr);
+        mCurrentDocument = nullptr;
+    }
+
+    void forgetDocument(Document::Ptr doc)
     {
-        // Forget about the document. Keeping a reference to it would prevent it
-        // from being garbage collected.
-        QObject::disconnect(mDocument.data(), nullptr, q, nullptr);
-        mDocument = nullptr;
+        // Keeping a reference to the document would prevent it from being
+        // garbage collected.
+        if (doc == mCurrentDocument) {
+            forgetCurrentDocument();
+        }
+        mDocuments.removeAll(doc);
+    }
+
+    void startNext()
+    {
+        if (mCurrentDocument) {
+            return;
+        }
+        if (mPendingUrls.isEmpty()) {
+            LOG("all done");
+            return;
+        }
+        if (DocumentFactory::instance()->availableCacheMemory() <= 0) {
+            LOG("no cache memory left, not preloading" << mPendingUrls);
+            mPendingUrls.clear();
+            return;
+        }
+        const QUrl url = mPendingUrls.takeFirst();
+        LOG("url=" << url);
+        mCurrentDocument = DocumentFactory::instance()->load(url, DecodeScheduler::Preload);
+        mDocuments << mCurrentDocument;
+        QObject::connect(mCurrentDocument.data(), &Document::kindDetermined, q, &Preloader::doPreload);
+        QObject::connect(mCurrentDocument.data(), &Document::metaInfoUpdated, q, &Preloader::doPreload);
+        QObject::connect(mCurrentDocument.data(), &Document::downSampledImageReady, q, &Preloader::slotDocumentDone);
+        QObject::connect(mCurrentDocument.data(), &Document::loaded, q, &Preloader::slotDocumentDone);
+        QObject::connect(mCurrentDocument.data(), &Document::loadingFailed, q, &Preloader::slotDocumentDone);
+        // The document may already know its kind and size
+        q->doPreload();
     }
 };
 
@@ -66,50 +116,100 @@ Preloader::~Preloader()
     delete d;
 }
 
-void Preloader::preload(const QUrl &url, const QSize &size)
+void Preloader::preload(const QList<QUrl> &urls, const QSize &size)
 {
-    LOG("url=" << url);
-    if (d->mDocument) {
-        disconnect(d->mDocument.data(), nullptr, this, nullptr);
-    }
-
-    d->mDocument = DocumentFactory::instance()->load(url);
+    LOG("urls=" << urls);
     d->mSize = size;
-    connect(d->mDocument.data(), &Document::metaInfoUpdated, this, &Preloader::doPreload);
 
-    if (d->mDocument->size().isValid()) {
-        LOG("size is already available");
-        doPreload();
+    // Release documents which left the window. If one of them is being
+    // preloaded, its loading keeps going but we stop waiting for it.
+    const QList<Document::Ptr> documents = d->mDocuments;
+    for (const Document::Ptr &doc : documents) {
+        if (!urls.contains(doc->url())) {
+            LOG("releasing" << doc->url());
+            d->forgetDocument(doc);
+        }
+    }
+
+    // Requeue the rest of the window in its new order
+    d->mPendingUrls.clear();
+    for (const QUrl &url : urls) {
+        const bool alreadyPreloaded = std::any_of(d->mDocuments.cbegin(), d->mDocuments.cend(), [&url](const Document::Ptr &doc) {
+            return doc->url() == url;
+        });
+        if (!alreadyPreloaded) {
+            d->mPendingUrls << url;
+        }
     }
+    d->startNext();
 }
 
 void Preloader::doPreload()
 {
-    if (!d->mDocument) {
+    if (!d->mCurrentDocument) {
         return;
     }
-
-    if (d->mDocument->loadingState() == Document::LoadingFailed) {
+    Document::Ptr doc = d->mCurrentDocument;
+    if (doc->loadingState() == Document::LoadingFailed) {
         LOG("loading failed");
-        d->forgetDocument();
+        d->forgetDocument(doc);
+        d->startNext();
         return;
     }
-
-    if (!d->mDocument->size().isValid()) {
+    if (doc->kind() != MimeTypeUtils::KIND_UNKNOWN && doc->kind() != MimeTypeUtils::KIND_RASTER_IMAGE) {
+        // Nothing more to preload for SVG or videos
+        LOG("not a raster image");
+        slotDocumentDone();
+        return;
+    }
+    if (!doc->size().isValid()) {
         LOG("size not available yet");
         return;
     }
+    disconnect(doc.data(), &Document::kindDetermined, this, &Preloader::doPreload);
+    disconnect(doc.data(), &Document::metaInfoUpdated, this, &Preloader::doPreload);
+
+    qreal zoom = qMin(d->mSize.width() / qreal(doc->width()), d->mSize.height() / qreal(doc->height()));
+    const bool downSampled = zoom < Document::maxDownSampledZoom();
+
+    // Do not preload images we cannot afford to keep: the cache would evict
+    // them, or documents we preloaded before, right away.
+    const qreal scale = downSampled ? zoom : 1.;
+    const qint64 expectedUsage = qint64(doc->width() * scale) * qint64(doc->height() * scale) * 4;
+    if (doc->loadingState() != Document::Loaded && expectedUsage > DocumentFactory::instance()->availableCacheMemory()) {
+        LOG("not enough cache memory to preload" << doc->url());
+        d->forgetDocument(doc);
+        d->mPendingUrls.clear();
+        return;
+    }
 
-    qreal zoom = qMin(d->mSize.width() / qreal(d->mDocument->width()), d->mSize.height() / qreal(d->mDocument->height()));
-
-    if (zoom < Document::maxDownSampledZoom()) {
+    if (downSampled) {
         LOG("preloading down sampled, zoom=" << zoom);
-        d->mDocument->prepareDownSampledImageForZoom(zoom);
+        if (doc->prepareDownSampledImageForZoom(zoom)) {
+            slotDocumentDone();
+        }
     } else {
         LOG("preloading full image");
-        d->mDocument->startLoadingFullImage();
+        if (doc->loadingState() == Document::Loaded) {
+            slotDocumentDone();
+        } else {
+            doc->startLoadingFullImage();
+        }
+    }
+}
+
+void Preloader::slotDocumentDone()
+{
+    if (!d->mCurrentDocument) {
+        return;
+    }
+    LOG("done" << d->mCurrentDocument->url());
+    if (d->mCurrentDocument->loadingState() == Document::LoadingFailed) {
+        d->forgetDocument(d->mCurrentDocument);
+    } else {
+        d->forgetCurrentDocument();
     }
-    d->forgetDocument();
+    d->startNext();
 }
 
 } // namespace
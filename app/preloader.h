@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #define PRELOADER_H
 
 // Qt
+#include <QList>
 #include <QObject>
 
 // KF
@@ -29,7 +30,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 // Local
 
 class QSize;
-
 class QUrl;
 
 namespace Gwenview
@@ -37,7 +37,11 @@ namespace Gwenview
 struct PreloaderPrivate;
 
 /**
- * This class preloads a document to fit a specific size.
+ * This class preloads documents to fit a specific size.
+ *
+ * It keeps a window of documents the user is likely to visit next. Documents
+ * are loaded one at a time, in the order they are passed to preload(), and
+ * preloading stops as soon as DocumentFactory runs out of cache memory.
  */
 class Preloader : public QObject
 {
@@ -46,10 +50,16 @@ public:
     explicit Preloader(QObject *parent);
     ~Preloader() override;
 
-    void preload(const QUrl &, const QSize &);
+    /**
+     * Replaces the preload window with @p urls, sorted from the most likely
+     * to be visited next to the least likely. Documents which are no longer
+     * part of the window are released so that DocumentFactory can evict them.
+     */
+    void preload(const QList<QUrl> &urls, const QSize &);
 
 private Q_SLOTS:
     void doPreload();
+    void slotDocumentDone();
 
 private:
     PreloaderPrivate *const d;
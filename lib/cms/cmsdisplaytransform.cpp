@@ -0,0 +1,150 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "cmsdisplaytransform.h"
+
+// Qt
+#include <QCache>
+#include <QList>
+#include <QtConcurrent>
+
+// Local
+#include "gvdebug.h"
+#include "gwenview_lib_debug.h"
+
+namespace Gwenview
+{
+namespace Cms
+{
+// Images with less pixels than this are converted in the calling thread,
+// splitting them would cost more than it saves
+static const int MIN_PARALLEL_PIXEL_COUNT = 512 * 512;
+
+// Number of rows converted by each parallel task
+static const int ROWS_PER_BAND = 64;
+
+// Number of transforms to keep around. Each one holds a precalculated
+// device link which takes a few hundred kilobytes.
+static const int MAX_CACHED_TRANSFORMS = 16;
+
+static Profile::Ptr sMonitorProfile;
+
+static QCache<QByteArray, DisplayTransform::Ptr> &transformCache()
+{
+    static QCache<QByteArray, DisplayTransform::Ptr> cache(MAX_CACHED_TRANSFORMS);
+    return cache;
+}
+
+static cmsUInt32Number cmsFormatForImageFormat(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+        return TYPE_BGRA_8;
+    case QImage::Format_Grayscale8:
+        return TYPE_GRAY_8;
+    case QImage::Format_RGB888:
+        return TYPE_RGB_8;
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888:
+        return TYPE_RGBA_8;
+    case QImage::Format_Grayscale16:
+        return TYPE_GRAY_16;
+    case QImage::Format_RGBA64:
+    case QImage::Format_RGBX64:
+        return TYPE_RGBA_16;
+    case QImage::Format_BGR888:
+        return TYPE_BGR_8;
+    default:
+        return 0;
+    }
+}
+
+DisplayTransform::DisplayTransform(cmsHTRANSFORM handle, QImage::Format format)
+    : mHandle(handle)
+    , mFormat(format)
+{
+}
+
+DisplayTransform::~DisplayTransform()
+{
+    cmsDeleteTransform(mHandle);
+}
+
+DisplayTransform::Ptr DisplayTransform::create(const Profile::Ptr &profile, QImage::Format format, cmsUInt32Number intent)
+{
+    GV_RETURN_VALUE_IF_FAIL(profile, Ptr());
+    const cmsUInt32Number cmsFormat = cmsFormatForImageFormat(format);
+    if (!cmsFormat) {
+        qCWarning(GWENVIEW_LIB_LOG) << "Gwenview cannot apply color profile on" << format << "images";
+        return {};
+    }
+
+    if (!sMonitorProfile) {
+        sMonitorProfile = Profile::getMonitorProfile();
+        if (!sMonitorProfile) {
+            qCWarning(GWENVIEW_LIB_LOG) << "Could not get monitor color profile";
+            return {};
+        }
+    }
+
+    const QByteArray key = profile->id() + '/' + QByteArray::number(intent) + '/' + QByteArray::number(int(format));
+    if (const Ptr *transform = transformCache().object(key)) {
+        return *transform;
+    }
+
+    // cmsFLAGS_NOCACHE makes the transform safe to use from several threads
+    // at once. lcms still turns it into an optimized device link, which for 8
+    // bit formats is a precalculated 3D table with tetrahedral interpolation.
+    const cmsHTRANSFORM handle = cmsCreateTransform(profile->handle(),
+                                                    cmsFormat,
+                                                    sMonitorProfile->handle(),
+                                                    cmsFormat,
+                                                    intent,
+                                                    cmsFLAGS_BLACKPOINTCOMPENSATION | cmsFLAGS_NOCACHE);
+    if (!handle) {
+        qCWarning(GWENVIEW_LIB_LOG) << "Could not create color transform for" << format << "images";
+        return {};
+    }
+    const Ptr transform(new DisplayTransform(handle, format));
+    transformCache().insert(key, new Ptr(transform));
+    return transform;
+}
+
+void DisplayTransform::resetMonitorProfile()
+{
+    sMonitorProfile = nullptr;
+    transformCache().clear();
+}
+
+QImage::Format DisplayTransform::format() const
+{
+    return mFormat;
+}
+
+void DisplayTransform::apply(QImage *image) const
+{
+    Q_ASSERT(image->format() == mFormat);
+    const int width = image->width();
+    const int height = image->height();
+    const cmsUInt32Number bytesPerLine = image->bytesPerLine();
+    uchar *bits = image->bits();
+
+    if (qint64(width) * height < MIN_PARALLEL_PIXEL_COUNT) {
+        cmsDoTransformLineStride(mHandle, bits, bits, width, height, bytesPerLine, bytesPerLine, 0, 0);
+        return;
+    }
+
+    QList<int> bands;
+    for (int row = 0; row < height; row += ROWS_PER_BAND) {
+        bands << row;
+    }
+    QtConcurrent::blockingMap(bands, [this, bits, width, height, bytesPerLine](int firstRow) {
+        const int rowCount = qMin(ROWS_PER_BAND, height - firstRow);
+        uchar *rows = bits + qsizetype(firstRow) * bytesPerLine;
+        cmsDoTransformLineStride(mHandle, rows, rows, width, rowCount, bytesPerLine, bytesPerLine, 0, 0);
+    });
+}
+
+} // namespace Cms
+} // namespace Gwenview
@@ -0,0 +1,73 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef CMSDISPLAYTRANSFORM_H
+#define CMSDISPLAYTRANSFORM_H
+
+#include <lib/gwenviewlib_export.h>
+
+// STL
+#include <memory>
+
+// Qt
+#include <QImage>
+
+// Local
+#include <lib/cms/cmsprofile.h>
+
+// lcms
+#include <lcms2.h>
+
+namespace Gwenview
+{
+namespace Cms
+{
+/**
+ * Converts images from a color profile to the monitor profile.
+ *
+ * Transforms are expensive to create, so they are cached: asking for a
+ * transform with the same source profile content, rendering intent and pixel
+ * format as a previous one returns the same instance.
+ */
+class GWENVIEWLIB_EXPORT DisplayTransform
+{
+public:
+    using Ptr = std::shared_ptr<const DisplayTransform>;
+
+    ~DisplayTransform();
+
+    /**
+     * Returns a transform for images in @p format from @p profile to the
+     * monitor profile, or a null pointer if no transform can be created.
+     * Must be called from the GUI thread.
+     */
+    static Ptr create(const Profile::Ptr &profile, QImage::Format format, cmsUInt32Number intent);
+
+    /**
+     * Forgets about the monitor profile and all cached transforms. The
+     * monitor profile is fetched again on the next call to create().
+     */
+    static void resetMonitorProfile();
+
+    /**
+     * Applies the transform to @p image, in place. Large images are split in
+     * bands of rows converted in parallel.
+     *
+     * This method is thread-safe, a transform can be applied to several
+     * images at once.
+     */
+    void apply(QImage *image) const;
+
+    QImage::Format format() const;
+
+private:
+    DisplayTransform(cmsHTRANSFORM handle, QImage::Format format);
+
+    cmsHTRANSFORM mHandle;
+    QImage::Format mFormat;
+};
+
+} // namespace Cms
+} // namespace Gwenview
+
+#endif /* CMSDISPLAYTRANSFORM_H */
@@ -36,6 +36,8 @@ extern "C" {
 
 // Qt
 #include <QBuffer>
+#include <QCryptographicHash>
+#include <QtEndian>
 
 // lcms
 #include <lcms2.h>
@@ -71,8 +73,13 @@ namespace Cms
 {
 
 //- JPEG -----------------------------------------------------------------------
-static cmsHPROFILE loadFromJpegData(const QByteArray &data)
+/**
+ * Reads the ICC profile from the APP2 markers. Sets @p parsed to false if
+ * libjpeg cannot read the header.
+ */
+static cmsHPROFILE loadFromJpegData(const QByteArray &data, bool *parsed)
 {
+    *parsed = false;
     cmsHPROFILE profile = nullptr;
     struct jpeg_decompress_struct srcinfo;
 
@@ -81,6 +88,7 @@ static cmsHPROFILE loadFromJpegData(const QByteArray &data)
     jpeg_create_decompress(&srcinfo);
     if (setjmp(srcErrorManager.jmp_buffer)) {
         qCCritical(GWENVIEW_LIB_LOG) << "libjpeg error in src\n";
+        jpeg_destroy_decompress(&srcinfo);
         return nullptr;
     }
 
@@ -91,6 +99,7 @@ static cmsHPROFILE loadFromJpegData(const QByteArray &data)
     setup_read_icc_profile(&srcinfo);
     jpeg_read_header(&srcinfo, true);
     jpeg_start_decompress(&srcinfo);
+    *parsed = true;
 
     uchar *profile_data;
     uint profile_len;
@@ -105,9 +114,110 @@ static cmsHPROFILE loadFromJpegData(const QByteArray &data)
     return profile;
 }
 
+//- TIFF -----------------------------------------------------------------------
+/**
+ * Reads the ICC profile from the InterColorProfile tag (34675) of the first
+ * IFD, without decoding any strip or tile. Sets @p parsed to false if the
+ * file is not a classic TIFF file or its first IFD cannot be read, in which
+ * case we cannot tell whether it has a profile.
+ */
+static cmsHPROFILE loadFromTiffData(const QByteArray &data, bool *parsed)
+{
+    *parsed = false;
+    const auto *bytes = reinterpret_cast<const uchar *>(data.constData());
+    const qint64 size = data.size();
+    if (size < 8) {
+        return nullptr;
+    }
+    bool bigEndian;
+    if (data.startsWith("II")) {
+        bigEndian = false;
+    } else if (data.startsWith("MM")) {
+        bigEndian = true;
+    } else {
+        return nullptr;
+    }
+    auto read16 = [bytes, bigEndian](qint64 pos) {
+        return bigEndian ? qFromBigEndian<quint16>(bytes + pos) : qFromLittleEndian<quint16>(bytes + pos);
+    };
+    auto read32 = [bytes, bigEndian](qint64 pos) {
+        return bigEndian ? qFromBigEndian<quint32>(bytes + pos) : qFromLittleEndian<quint32>(bytes + pos);
+    };
+    if (read16(2) != 42) {
+        // Not a classic TIFF (BigTIFF uses 43)
+        return nullptr;
+    }
+
+    const qint64 ifdOffset = read32(4);
+    if (ifdOffset + 2 > size) {
+        return nullptr;
+    }
+    const int entryCount = read16(ifdOffset);
+    if (ifdOffset + 2 + entryCount * 12 > size) {
+        return nullptr;
+    }
+    for (int idx = 0; idx < entryCount; ++idx) {
+        const qint64 entry = ifdOffset + 2 + idx * 12;
+        if (read16(entry) != 34675) {
+            continue;
+        }
+        const qint64 length = read32(entry + 4);
+        // Values of 4 bytes or less are stored in the entry itself, but no
+        // ICC profile is that small
+        const qint64 offset = read32(entry + 8);
+        if (length <= 4 || offset + length > size) {
+            return nullptr;
+        }
+        LOG("Found a profile, length:" << length);
+        *parsed = true;
+        return cmsOpenProfileFromMem(bytes + offset, length);
+    }
+    *parsed = true;
+    return nullptr;
+}
+
+//- WebP -----------------------------------------------------------------------
+/**
+ * Reads the ICC profile from the ICCP chunk of an extended WebP file. The
+ * chunk comes before any image data. Sets @p parsed to false if the chunks
+ * cannot be read up to the ICCP chunk or the image data.
+ */
+static cmsHPROFILE loadFromWebPData(const QByteArray &data, bool *parsed)
+{
+    *parsed = false;
+    const auto *bytes = reinterpret_cast<const uchar *>(data.constData());
+    const qint64 size = data.size();
+    if (size < 12 || !data.startsWith("RIFF") || data.mid(8, 4) != "WEBP") {
+        return nullptr;
+    }
+    qint64 pos = 12;
+    while (pos + 8 <= size) {
+        const QByteArray fourCC = data.mid(pos, 4);
+        const qint64 length = qFromLittleEndian<quint32>(bytes + pos + 4);
+        pos += 8;
+        if (fourCC == "ICCP") {
+            if (pos + length > size) {
+                return nullptr;
+            }
+            LOG("Found a profile, length:" << length);
+            *parsed = true;
+            return cmsOpenProfileFromMem(bytes + pos, length);
+        }
+        if (fourCC == "VP8 " || fourCC == "VP8L" || fourCC == "ANIM") {
+            // The ICCP chunk must come before these ones
+            *parsed = true;
+            return nullptr;
+        }
+        // Chunks are padded to an even size
+        pos += length + (length & 1);
+    }
+    return nullptr;
+}
+
 //- Profile class --------------------------------------------------------------
 struct ProfilePrivate {
     cmsHPROFILE mProfile;
+    QByteArray mId;
 
     void reset()
     {
@@ -144,14 +254,22 @@ Profile::~Profile()
     delete d;
 }
 
-Profile::Ptr Profile::loadFromImageData(const QByteArray &data, const QByteArray &format)
+Profile::Ptr Profile::loadFromImageData(const QByteArray &data, const QByteArray &format, bool *parsed)
 {
     Profile::Ptr ptr;
     cmsHPROFILE hProfile = nullptr;
+    bool dataParsed = false;
     if (format == "png") {
-        hProfile = loadFromPngData(data);
+        hProfile = loadFromPngData(data, &dataParsed);
     } else if (format == "jpeg") {
-        hProfile = loadFromJpegData(data);
+        hProfile = loadFromJpegData(data, &dataParsed);
+    } else if (format == "tiff" || format == "tif") {
+        hProfile = loadFromTiffData(data, &dataParsed);
+    } else if (format == "webp") {
+        hProfile = loadFromWebPData(data, &dataParsed);
+    }
+    if (parsed) {
+        *parsed = dataParsed;
     }
     if (hProfile) {
         ptr = new Profile(hProfile);
@@ -206,6 +324,24 @@ cmsHPROFILE Profile::handle() const
     return d->mProfile;
 }
 
+QByteArray Profile::id() const
+{
+    GV_RETURN_VALUE_IF_FAIL(d->mProfile, QByteArray());
+    if (d->mId.isEmpty()) {
+        cmsUInt32Number size = 0;
+        if (!cmsSaveProfileToMem(d->mProfile, nullptr, &size)) {
+            qCWarning(GWENVIEW_LIB_LOG) << "Could not serialize color profile";
+            // Do not let unrelated profiles share an id
+            d->mId = QByteArray::number(quintptr(d->mProfile));
+            return d->mId;
+        }
+        QByteArray data(size, Qt::Uninitialized);
+        cmsSaveProfileToMem(d->mProfile, data.data(), &size);
+        d->mId = QCryptographicHash::hash(data, QCryptographicHash::Md5);
+    }
+    return d->mId;
+}
+
 QString Profile::copyright() const
 {
     return d->readInfo(cmsInfoCopyright);
@@ -64,7 +64,21 @@ public:
 
     cmsHPROFILE handle() const;
 
-    static Profile::Ptr loadFromImageData(const QByteArray &data, const QByteArray &format);
+    /**
+     * Returns a checksum of the profile content, which can be used to tell
+     * whether two profiles are identical.
+     */
+    QByteArray id() const;
+
+    /**
+     * Reads the profile stored in @p data without decoding the image.
+     *
+     * If @p parsed is not null, it is set to true if @p data could be read
+     * well enough to tell whether it has a profile. In that case a null
+     * profile means the image has none, there is no need to decode it to
+     * find out.
+     */
+    static Profile::Ptr loadFromImageData(const QByteArray &data, const QByteArray &format, bool *parsed = nullptr);
     static Profile::Ptr loadFromExiv2Image(const Exiv2::Image *image);
     static Profile::Ptr loadFromICC(const QByteArray &data);
     static Profile::Ptr getMonitorProfile();
@@ -56,8 +56,9 @@ static void readPngChunk(png_structp png_ptr, png_bytep data, png_size_t length)
     }
 }
 
-cmsHPROFILE loadFromPngData(const QByteArray &data)
+cmsHPROFILE loadFromPngData(const QByteArray &data, bool *parsed)
 {
+    *parsed = false;
     QBuffer buffer;
     buffer.setBuffer(const_cast<QByteArray *>(&data));
     buffer.open(QIODevice::ReadOnly);
@@ -103,6 +104,12 @@ cmsHPROFILE loadFromPngData(const QByteArray &data)
     int compression_type;
     png_uint_32 proflen;
 
+    png_uint_32 colorChunks = PNG_INFO_gAMA | PNG_INFO_cHRM | PNG_INFO_sRGB;
+#ifdef PNG_INFO_cICP
+    colorChunks |= PNG_INFO_cICP;
+#endif
+    *parsed = !png_get_valid(png_ptr, info_ptr, colorChunks);
+
     cmsHPROFILE profile = nullptr;
     if (png_get_iCCP(png_ptr, info_ptr, &profile_name, &compression_type, &profile_data, &proflen)) {
         profile = cmsOpenProfileFromMem(profile_data, proflen);
@@ -41,7 +41,12 @@ namespace Cms
  * file as jpeg code: libpng complains about setjmp being included twice.
  */
 
-cmsHPROFILE loadFromPngData(const QByteArray &data);
+/**
+ * Reads the profile from the iCCP chunk. Sets @p parsed to false if the chunks
+ * cannot be read, or if other chunks describe the color space: decoders derive
+ * a profile from gAMA, cHRM, sRGB or cICP chunks.
+ */
+cmsHPROFILE loadFromPngData(const QByteArray &data, bool *parsed);
 
 } // namespace Cms
 } // namespace Gwenview
@@ -0,0 +1,128 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Self
+#include "decodescheduler.h"
+
+// Qt
+#include <QCoreApplication>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+// Local
+#include "gwenview_lib_debug.h"
+
+namespace Gwenview
+{
+#undef ENABLE_LOG
+#undef LOG
+// #define ENABLE_LOG
+#ifdef ENABLE_LOG
+#define LOG(x) qCDebug(GWENVIEW_LIB_LOG) << x
+#else
+#define LOG(x) ;
+#endif
+
+/**
+ * Keeps the counters of the scheduler up to date, including for tasks which
+ * are dropped from the queue without being run
+ */
+class ScheduledTask : public QRunnable
+{
+public:
+    ScheduledTask(QAtomicInt *queuedCount, QAtomicInt *runningCount, std::function<void()> &&task)
+        : mQueuedCount(queuedCount)
+        , mRunningCount(runningCount)
+        , mTask(std::move(task))
+    {
+        mQueuedCount->ref();
+    }
+
+    ~ScheduledTask() override
+    {
+        if (!mStarted) {
+            mQueuedCount->deref();
+        }
+    }
+
+    void run() override
+    {
+        mStarted = true;
+        mQueuedCount->deref();
+        mRunningCount->ref();
+        mTask();
+        mRunningCount->deref();
+    }
+
+private:
+    QAtomicInt *const mQueuedCount;
+    QAtomicInt *const mRunningCount;
+    std::function<void()> mTask;
+    bool mStarted = false;
+};
+
+DecodeScheduler *DecodeScheduler::instance()
+{
+    static DecodeScheduler scheduler;
+    return &scheduler;
+}
+
+DecodeScheduler::DecodeScheduler()
+    : mPool(new QThreadPool)
+{
+    mPool->setMaxThreadCount(QThread::idealThreadCount());
+    if (qApp) {
+        // Do not start queued tasks while the objects they work on are being
+        // destroyed
+        QObject::connect(
+            qApp,
+            &QCoreApplication::aboutToQuit,
+            mPool,
+            [this]() {
+                mPool->clear();
+                mPool->waitForDone();
+            },
+            Qt::DirectConnection);
+    }
+}
+
+DecodeScheduler::~DecodeScheduler()
+{
+    mPool->clear();
+    mPool->waitForDone();
+    delete mPool;
+}
+
+void DecodeScheduler::schedule(Priority priority, std::function<void()> &&task)
+{
+    auto runnable = new ScheduledTask(&mQueuedCount[priority], &mRunningCount, std::move(task));
+
+    if (priority == CurrentView && mPool->activeThreadCount() >= mPool->maxThreadCount()) {
+        // All threads are busy, most likely with less important work. Do not
+        // wait for one of them to be done: the visible image comes first.
+        LOG("Pool busy, running on an extra thread");
+        mPool->reserveThread();
+        mPool->startOnReservedThread(runnable);
+        return;
+    }
+    // QThreadPool runs tasks with the highest priority value first
+    mPool->start(runnable, Background - priority);
+}
+
+int DecodeScheduler::queuedCount(Priority priority) const
+{
+    return mQueuedCount[priority].loadRelaxed();
+}
+
+int DecodeScheduler::runningCount() const
+{
+    return mRunningCount.loadRelaxed();
+}
+
+QThreadPool *DecodeScheduler::threadPool() const
+{
+    return mPool;
+}
+
+} // namespace Gwenview
@@ -0,0 +1,94 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef DECODESCHEDULER_H
+#define DECODESCHEDULER_H
+
+#include <lib/gwenviewlib_export.h>
+
+// STL
+#include <functional>
+#include <memory>
+#include <type_traits>
+
+// Qt
+#include <QAtomicInt>
+#include <QFuture>
+#include <QPromise>
+
+class QThreadPool;
+
+namespace Gwenview
+{
+/**
+ * Runs image decoding work on a CPU-sized thread pool shared by the views,
+ * the preloader and the document jobs.
+ *
+ * Each task belongs to a priority class. Idle threads always pick the queued
+ * task of the most important class first, so a preload cannot delay the
+ * image the user is looking at. Tasks of the CurrentView class do not even
+ * wait for a thread to become idle: if the pool is busy, they run on an extra
+ * thread.
+ *
+ * Thumbnails are not generated here: their tasks may block while the
+ * thumbnails already generated are written, see ThumbnailGenerator.
+ */
+class GWENVIEWLIB_EXPORT DecodeScheduler
+{
+public:
+    /// Priority classes, most important first
+    enum Priority {
+        CurrentView,
+        CompareView,
+        Preload,
+        Background,
+    };
+    static constexpr int PriorityCount = Background + 1;
+
+    static DecodeScheduler *instance();
+    ~DecodeScheduler();
+
+    /**
+     * Runs @p function with @p args in the pool and returns a future for its
+     * result. Like QtConcurrent::run(), the future is running as soon as this
+     * returns, even if the task is still queued.
+     */
+    template<typename Function, typename... Args>
+    auto run(Priority priority, Function &&function, Args &&...args)
+    {
+        auto call = std::bind(std::forward<Function>(function), std::forward<Args>(args)...);
+        using Result = std::invoke_result_t<decltype(call) &>;
+        auto promise = std::make_shared<QPromise<Result>>();
+        QFuture<Result> future = promise->future();
+        promise->start();
+        schedule(priority, [promise, call]() mutable {
+            if constexpr (std::is_void_v<Result>) {
+                call();
+            } else {
+                promise->addResult(call());
+            }
+            promise->finish();
+        });
+        return future;
+    }
+
+    /// Number of tasks of the @p priority class waiting for a thread
+    int queuedCount(Priority priority) const;
+
+    /// Number of tasks currently running, all classes included
+    int runningCount() const;
+
+    QThreadPool *threadPool() const;
+
+private:
+    DecodeScheduler();
+    void schedule(Priority priority, std::function<void()> &&task);
+
+    QThreadPool *mPool;
+    QAtomicInt mQueuedCount[PriorityCount];
+    QAtomicInt mRunningCount;
+};
+
+} // namespace Gwenview
+
+#endif /* DECODESCHEDULER_H */
@@ -31,6 +31,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #include <lib/orientation.h>
 
 class QImage;
+class QRect;
 
 namespace Gwenview
 {
@@ -52,6 +53,18 @@ public:
      */
     virtual void setImage(const QImage &) = 0;
 
+    /**
+     * Replaces the current image with image, which has the same size and
+     * only differs from the current one inside rect. This avoids having to
+     * regenerate cached data for the whole image.
+     *
+     * The same restrictions as for setImage() apply.
+     */
+    virtual void updateImageRect(const QImage &image, const QRect & /*rect*/)
+    {
+        setImage(image);
+    }
+
     /**
      * Apply a transformation to the document image.
      *
@@ -33,6 +33,7 @@ namespace Gwenview
 {
 struct AbstractDocumentImplPrivate {
     Document *mDocument = nullptr;
+    MappedFile::Ptr mMappedFile;
 };
 
 AbstractDocumentImpl::AbstractDocumentImpl(Document *document)
@@ -51,8 +52,23 @@ Document *AbstractDocumentImpl::document() const
     return d->mDocument;
 }
 
+bool AbstractDocumentImpl::isMappedData(const QByteArray &data) const
+{
+    return d->mMappedFile && d->mMappedFile->contains(data);
+}
+
+void AbstractDocumentImpl::setMappedFile(const MappedFile::Ptr &mappedFile)
+{
+    d->mMappedFile = mappedFile;
+}
+
 void AbstractDocumentImpl::switchToImpl(AbstractDocumentImpl *impl)
 {
+    // The new implementation may have been given data pointing inside our
+    // mapping, make sure it stays valid
+    if (!impl->d->mMappedFile) {
+        impl->d->mMappedFile = d->mMappedFile;
+    }
     d->mDocument->switchToImpl(impl);
 }
 
@@ -61,6 +77,11 @@ void AbstractDocumentImpl::setDocumentImage(const QImage &image)
     d->mDocument->setImageInternal(image);
 }
 
+void AbstractDocumentImpl::updateDocumentImageRect(const QImage &image, const QRect &rect)
+{
+    d->mDocument->updateImageRectInternal(image, rect);
+}
+
 void AbstractDocumentImpl::setDocumentImageSize(const QSize &size)
 {
     d->mDocument->setSize(size);
@@ -86,6 +107,16 @@ void AbstractDocumentImpl::setDocumentDownSampledImage(const QImage &image, int
     d->mDocument->setDownSampledImage(image, invertedZoom);
 }
 
+void AbstractDocumentImpl::setDocumentPreviewImage(const QImage &image)
+{
+    d->mDocument->setPreviewImage(image);
+}
+
+void AbstractDocumentImpl::setDocumentFullImageLoadingSlow(bool slow)
+{
+    d->mDocument->setFullImageLoadingSlow(slow);
+}
+
 void AbstractDocumentImpl::setDocumentErrorString(const QString &string)
 {
     d->mDocument->setErrorString(string);
@@ -29,6 +29,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 
 // Local
 #include <lib/document/document.h>
+#include <lib/mappedfile.h>
 #include <lib/orientation.h>
 
 class QImage;
@@ -101,6 +102,13 @@ public:
         return nullptr;
     }
 
+    /**
+     * Returns true if @p data points inside the file mapping the document has
+     * been loaded from, in which case it does not use any heap memory but
+     * must not outlive the implementation.
+     */
+    bool isMappedData(const QByteArray &data) const;
+
 Q_SIGNALS:
     void imageRectUpdated(const QRect &);
     void metaInfoLoaded();
@@ -110,13 +118,22 @@ Q_SIGNALS:
 
 protected:
     void setDocumentImage(const QImage &image);
+    void updateDocumentImageRect(const QImage &image, const QRect &rect);
     void setDocumentImageSize(const QSize &size);
     void setDocumentKind(MimeTypeUtils::Kind);
     void setDocumentFormat(const QByteArray &format);
     void setDocumentExiv2Image(std::unique_ptr<Exiv2::Image>);
     void setDocumentDownSampledImage(const QImage &, int invertedZoom);
+    void setDocumentPreviewImage(const QImage &);
+    void setDocumentFullImageLoadingSlow(bool);
     void setDocumentCmsProfile(const Cms::Profile::Ptr &profile);
     void setDocumentErrorString(const QString &);
+
+    /**
+     * Keeps @p mappedFile alive as long as this implementation, or the ones
+     * it switches to, may access data pointing inside it.
+     */
+    void setMappedFile(const MappedFile::Ptr &mappedFile);
     void switchToImpl(AbstractDocumentImpl *impl);
 
 private:
@@ -94,53 +94,6 @@ void DocumentPrivate::scheduleImageLoading(int invertedZoom)
     impl->loadImage(invertedZoom);
 }
 
-void DocumentPrivate::scheduleImageDownSampling(int invertedZoom)
-{
-    LOG("invertedZoom=" << invertedZoom);
-    auto job = qobject_cast<DownSamplingJob *>(mCurrentJob.data());
-    if (job && job->mInvertedZoom == invertedZoom) {
-        LOG("Current job is already doing it");
-        return;
-    }
-
-    // Remove any previously scheduled downsampling job
-    DocumentJobQueue::Iterator it;
-    for (it = mJobQueue.begin(); it != mJobQueue.end(); ++it) {
-        auto job = qobject_cast<DownSamplingJob *>(*it);
-        if (!job) {
-            continue;
-        }
-        if (job->mInvertedZoom == invertedZoom) {
-            // Already scheduled, nothing to do
-            LOG("Already scheduled");
-            return;
-        } else {
-            LOG("Removing downsampling job");
-            mJobQueue.erase(it);
-            delete job;
-        }
-    }
-    q->enqueueJob(new DownSamplingJob(invertedZoom));
-}
-
-void DocumentPrivate::downSampleImage(int invertedZoom)
-{
-    mDownSampledImageMap[invertedZoom] = mImage.scaled(mImage.size() / invertedZoom, Qt::KeepAspectRatio, Qt::FastTransformation);
-    if (mDownSampledImageMap[invertedZoom].size().isEmpty()) {
-        mDownSampledImageMap[invertedZoom] = mImage;
-    }
-    Q_EMIT q->downSampledImageReady();
-}
-
-//- DownSamplingJob ---------------------------------------
-void DownSamplingJob::doStart()
-{
-    DocumentPrivate *d = document()->d;
-    d->downSampleImage(mInvertedZoom);
-    setError(NoError);
-    emitResult();
-}
-
 //- Document ----------------------------------------------
 qreal Document::maxDownSampledZoom()
 {
@@ -155,6 +108,9 @@ Document::Document(const QUrl &url)
     d->mImpl = nullptr;
     d->mUrl = url;
     d->mKeepRawData = false;
+    d->mDecodePriority = DecodeScheduler::Background;
+
+    connect(&d->mImagePyramid, &ImagePyramid::levelReady, this, &Document::downSampledImageReady);
 }
 
 Document::~Document()
@@ -172,6 +128,9 @@ void Document::reload()
     d->mSize = QSize();
     d->mImage = QImage();
     d->mDownSampledImageMap.clear();
+    d->mPreviewImage = QImage();
+    d->mFullImageLoadingSlow = false;
+    d->mImagePyramid.setImage(QImage());
     d->mExiv2Image.reset();
     d->mKind = MimeTypeUtils::KIND_UNKNOWN;
     d->mFormat = QByteArray();
@@ -204,6 +163,16 @@ inline int invertedZoomForZoom(qreal zoom)
     return invertedZoom;
 }
 
+/**
+ * Returns the image pyramid level matching invertedZoom
+ */
+inline int pyramidLevelForInvertedZoom(const ImagePyramid &pyramid, int invertedZoom)
+{
+    int level = 0;
+    for (; (1 << level) < invertedZoom; ++level) { }
+    return qMin(level, pyramid.levelCount() - 1);
+}
+
 const QImage &Document::downSampledImageForZoom(qreal zoom) const
 {
     static const QImage sNullImage;
@@ -213,19 +182,21 @@ const QImage &Document::downSampledImageForZoom(qreal zoom) const
         return d->mImage;
     }
 
-    if (!d->mDownSampledImageMap.contains(invertedZoom)) {
-        if (!d->mImage.isNull()) {
-            // Special case: if we have the full image and the down sampled
-            // image would be too small, return the original image.
-            const QSize downSampledSize = d->mImage.size() / invertedZoom;
-            if (downSampledSize.isEmpty()) {
-                return d->mImage;
-            }
-        }
-        return sNullImage;
+    if (loadingState() == Loaded) {
+        // We have the full image, down sampled versions come from the
+        // pyramid. If the level is not built yet, this schedules it and
+        // returns the closest larger one, down to the original image.
+        return d->mImagePyramid.availableLevel(pyramidLevelForInvertedZoom(d->mImagePyramid, invertedZoom));
     }
 
-    return d->mDownSampledImageMap[invertedZoom];
+    // While loading, fall back to a larger down sampled image if we have one
+    for (; invertedZoom > 1; invertedZoom /= 2) {
+        auto it = d->mDownSampledImageMap.constFind(invertedZoom);
+        if (it != d->mDownSampledImageMap.constEnd()) {
+            return it.value();
+        }
+    }
+    return sNullImage;
 }
 
 Document::LoadingState Document::loadingState() const
@@ -254,12 +225,22 @@ void Document::setImageInternal(const QImage &image)
 {
     d->mImage = image;
     d->mDownSampledImageMap.clear();
+    d->mPreviewImage = QImage();
+    d->mImagePyramid.setImage(image);
 
     // If we didn't get the image size before decoding the full image, set it
     // now
     setSize(d->mImage.size());
 }
 
+void Document::updateImageRectInternal(const QImage &image, const QRect &rect)
+{
+    Q_ASSERT(image.size() == d->mImage.size());
+    d->mImage = image;
+    d->mDownSampledImageMap.clear();
+    d->mImagePyramid.updateImageRect(image, rect);
+}
+
 QUrl Document::url() const
 {
     return d->mUrl;
@@ -267,6 +248,8 @@ QUrl Document::url() const
 
 QByteArray Document::rawData() const
 {
+    // Not copied even if it points inside the file mapping: implementations
+    // pass the mapping on to each other until the document is reloaded
     return d->mImpl->rawData();
 }
 
@@ -359,11 +342,22 @@ bool Document::hasAlphaChannel() const
     }
 }
 
-int Document::memoryUsage() const
+qint64 Document::memoryUsage() const
 {
-    // FIXME: Take undo stack into account
-    int usage = d->mImage.sizeInBytes();
-    usage += rawData().length();
+    qint64 usage = d->mImage.sizeInBytes();
+    for (const QImage &image : qAsConst(d->mDownSampledImageMap)) {
+        usage += image.sizeInBytes();
+    }
+    usage += d->mImagePyramid.memoryUsage();
+    usage += d->mPreviewImage.sizeInBytes();
+    // Image operations keep a copy of the image they replace to be able to
+    // undo, so assume each undo step holds one full image.
+    usage += qint64(d->mUndoStack.count()) * d->mImage.sizeInBytes();
+    const QByteArray rawData = d->mImpl->rawData();
+    if (!d->mImpl->isMappedData(rawData)) {
+        // Mapped data lives in the page cache, not in our heap
+        usage += rawData.length();
+    }
     return usage;
 }
 
@@ -401,6 +395,29 @@ void Document::setDownSampledImage(const QImage &image, int invertedZoom)
     Q_EMIT downSampledImageReady();
 }
 
+void Document::setPreviewImage(const QImage &image)
+{
+    d->mPreviewImage = image;
+    // Views may have been set up from the size in the header, before the
+    // preview was available
+    Q_EMIT metaInfoUpdated();
+}
+
+const QImage &Document::previewImage() const
+{
+    return d->mPreviewImage;
+}
+
+void Document::setFullImageLoadingSlow(bool slow)
+{
+    d->mFullImageLoadingSlow = slow;
+}
+
+bool Document::isFullImageLoadingSlow() const
+{
+    return d->mFullImageLoadingSlow;
+}
+
 QString Document::errorString() const
 {
     return d->mErrorString;
@@ -451,8 +468,7 @@ bool Document::prepareDownSampledImageForZoom(qreal zoom)
         qCWarning(GWENVIEW_LIB_LOG) << "Image has failed to load, not doing anything";
         return false;
     } else if (loadingState() == Loaded) {
-        d->scheduleImageDownSampling(invertedZoom);
-        return false;
+        return d->mImagePyramid.prepareLevel(pyramidLevelForInvertedZoom(d->mImagePyramid, invertedZoom));
     }
 
     // Schedule down sampled image loading
@@ -568,8 +584,22 @@ Cms::Profile::Ptr Document::cmsProfile() const
     return d->mCmsProfile;
 }
 
+DecodeScheduler::Priority Document::decodePriority() const
+{
+    return d->mDecodePriority;
+}
+
+void Document::setDecodePriority(DecodeScheduler::Priority priority)
+{
+    d->mDecodePriority = priority;
+    d->mImagePyramid.setDecodePriority(priority);
+}
+
+ImagePyramid *Document::imagePyramid() const
+{
+    return &d->mImagePyramid;
+}
+
 } // namespace
 
 #include "moc_document.cpp"
-
-#include "moc_document_p.cpp"
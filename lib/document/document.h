@@ -32,6 +32,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 // Local
 #include <lib/cms/cmsprofile.h>
+#include <lib/decodescheduler.h>
 #include <lib/mimetypeutils.h>
 
 class QImage;
@@ -55,6 +56,7 @@ class DocumentJob;
 class DocumentFactory;
 struct DocumentPrivate;
 class ImageMetaInfoModel;
+class ImagePyramid;
 
 /**
  * This class represents an image.
@@ -120,8 +122,33 @@ public:
 
     const QImage &image() const;
 
+    /**
+     * Returns the best image available right now to display the document at
+     * @a zoom, without scaling anything on the calling thread. If the down
+     * sampled image for @a zoom is not ready, a larger one is returned, or a
+     * null image if there is none yet. Once the full image is loaded, missing
+     * down sampled images are scheduled and downSampledImageReady() is emitted
+     * as each of them becomes available.
+     */
     const QImage &downSampledImageForZoom(qreal zoom) const;
 
+    /**
+     * Returns a low resolution version of the image, usually the preview
+     * embedded in its metadata, which can be shown scaled to size() while
+     * the image is being decoded. For a document loaded progressively it is
+     * a partial decode of the data received so far. It is null once image()
+     * is available.
+     */
+    const QImage &previewImage() const;
+
+    /**
+     * Returns true if startLoadingFullImage() starts a decoding which takes
+     * seconds and cannot be canceled, as for RAW images decoded at full
+     * resolution. Views should then show previewImage() and only load the
+     * full image once they need its resolution.
+     */
+    bool isFullImageLoadingSlow() const;
+
     /**
      * Returns an implementation of AbstractDocumentEditor if this document can
      * be edited.
@@ -159,18 +186,33 @@ public:
     bool keepRawData() const;
 
     /**
-     * Returns how much bytes the document is using
+     * Returns how much bytes the document is using, including down sampled
+     * images and undo data
      */
-    int memoryUsage() const;
+    qint64 memoryUsage() const;
 
     /**
      * Returns the compressed version of the document, if it is still
-     * available.
+     * available. The data may point inside a mapping of the file, in which
+     * case it is only valid until the document is reloaded or destroyed.
      */
     QByteArray rawData() const;
 
     Cms::Profile::Ptr cmsProfile() const;
 
+    /**
+     * Priority of the decoding work done for this document. Work which has
+     * already been submitted keeps the priority it was submitted with.
+     */
+    DecodeScheduler::Priority decodePriority() const;
+    void setDecodePriority(DecodeScheduler::Priority priority);
+
+    /**
+     * Returns the down sampled versions of image(), which are built on
+     * demand.
+     */
+    ImagePyramid *imagePyramid() const;
+
     /**
      * Returns a QSvgRenderer which can be used to render this document if it is
      * an SVG image. Returns a NULL pointer otherwise.
@@ -232,14 +274,16 @@ private:
     friend class AbstractDocumentImpl;
     friend class DocumentFactory;
     friend struct DocumentPrivate;
-    friend class DownSamplingJob;
 
     void setImageInternal(const QImage &);
+    void updateImageRectInternal(const QImage &, const QRect &);
     void setKind(MimeTypeUtils::Kind);
     void setFormat(const QByteArray &);
     void setSize(const QSize &);
     void setExiv2Image(std::unique_ptr<Exiv2::Image>);
     void setDownSampledImage(const QImage &, int invertedZoom);
+    void setPreviewImage(const QImage &);
+    void setFullImageLoadingSlow(bool);
     void switchToImpl(AbstractDocumentImpl *impl);
     void setErrorString(const QString &);
     void setCmsProfile(const Cms::Profile::Ptr &);
@@ -26,6 +26,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 
 // Local
 #include <document/documentjob.h>
+#include <document/imagepyramid.h>
 #include <imagemetainfomodel.h>
 
 // KF
@@ -52,6 +53,7 @@ struct DocumentPrivate {
     bool mKeepRawData;
     QPointer<DocumentJob> mCurrentJob;
     DocumentJobQueue mJobQueue;
+    DecodeScheduler::Priority mDecodePriority;
 
     /**
      * @defgroup imagedata should be reset in reload()
@@ -60,6 +62,9 @@ struct DocumentPrivate {
     QSize mSize;
     QImage mImage;
     QMap<int, QImage> mDownSampledImageMap;
+    QImage mPreviewImage;
+    bool mFullImageLoadingSlow = false;
+    ImagePyramid mImagePyramid;
     std::unique_ptr<Exiv2::Image> mExiv2Image;
     MimeTypeUtils::Kind mKind;
     QByteArray mFormat;
@@ -70,22 +75,6 @@ struct DocumentPrivate {
     /** @} */
 
     void scheduleImageLoading(int invertedZoom);
-    void scheduleImageDownSampling(int invertedZoom);
-    void downSampleImage(int invertedZoom);
-};
-
-class DownSamplingJob : public DocumentJob
-{
-    Q_OBJECT
-public:
-    DownSamplingJob(int invertedZoom)
-        : mInvertedZoom(invertedZoom)
-    {
-    }
-
-    void doStart() override;
-
-    int mInvertedZoom;
 };
 
 } // namespace
@@ -22,7 +22,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 // Qt
 #include <QByteArray>
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QMap>
+#include <QTimer>
 #include <QUndoGroup>
 #include <QUrl>
 
@@ -30,6 +32,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 // Local
 #include "gwenview_lib_debug.h"
+#include "gwenviewconfig.h"
+#include "memoryutils.h"
 #include <gvdebug.h>
 
 namespace Gwenview
@@ -43,9 +47,13 @@ namespace Gwenview
 #define LOG(x) ;
 #endif
 
+/**
+ * Optional hard limit on the number of unreferenced documents kept in cache,
+ * on top of the memory budget. -1 means no limit.
+ */
 inline int getMaxUnreferencedImages()
 {
-    int defaultValue = 3;
+    int defaultValue = -1;
     QByteArray ba = qgetenv("GV_MAX_UNREFERENCED_IMAGES");
     if (ba.isEmpty()) {
         return defaultValue;
@@ -58,6 +66,30 @@ inline int getMaxUnreferencedImages()
 
 static const int MAX_UNREFERENCED_IMAGES = getMaxUnreferencedImages();
 
+/**
+ * How many milliseconds of "freshness" a document gains for each millisecond
+ * it took to load. A document which took 2 seconds to decode is kept as if it
+ * had been accessed 20 seconds later than it really was.
+ */
+static const int LOADING_COST_WEIGHT = 10;
+
+/**
+ * Returns how many bytes the document cache may use.
+ */
+static qint64 memoryBudget(qint64 currentUsage)
+{
+    const qint64 totalMemory = MemoryUtils::getTotalMemory();
+    qint64 budget = totalMemory * GwenviewConfig::percentageOfMemoryForDocumentCache();
+
+    // Do not push the system into swap: only allow growing into half of the
+    // memory which is still free.
+    const qint64 freeMemory = MemoryUtils::getFreeMemory();
+    if (freeMemory > 0) {
+        budget = qMin(budget, currentUsage + freeMemory / 2);
+    }
+    return budget;
+}
+
 /**
  * This internal structure holds the document and the last time it has been
  * accessed. This access time is used to "garbage collect" the loaded
@@ -66,6 +98,18 @@ static const int MAX_UNREFERENCED_IMAGES = getMaxUnreferencedImages();
 struct DocumentInfo {
     Document::Ptr mDocument;
     QDateTime mLastAccess;
+
+    /**
+     * Measures how long the document took to load. Expensive documents (RAW,
+     * FITS, huge images...) are kept longer than cheap ones.
+     */
+    QElapsedTimer mLoadingTimer;
+    qint64 mLoadingCost = 0;
+
+    qint64 retentionScore() const
+    {
+        return mLastAccess.toMSecsSinceEpoch() + mLoadingCost * LOADING_COST_WEIGHT;
+    }
 };
 
 /**
@@ -80,32 +124,43 @@ struct DocumentFactoryPrivate {
     QUndoGroup mUndoGroup;
 
     /**
-     * Removes items in a map if they are no longer referenced elsewhere
+     * Removes items in a map if they are no longer referenced elsewhere and
+     * the documents use more memory than allowed
      */
     void garbageCollect(DocumentMap &map)
     {
-        // Build a map of all unreferenced images. We use a MultiMap because in
-        // rare cases documents may get accessed at the same millisecond.
+        // Build a map of all unreferenced images, sorted by how much we want
+        // to keep them. We use a MultiMap because in rare cases documents may
+        // get the same score.
         // See https://bugs.kde.org/show_bug.cgi?id=296401
-        using UnreferencedImages = QMultiMap<QDateTime, QUrl>;
+        using UnreferencedImages = QMultiMap<qint64, QUrl>;
         UnreferencedImages unreferencedImages;
 
+        qint64 usage = 0;
         DocumentMap::Iterator it = map.begin(), end = map.end();
         for (; it != end; ++it) {
             DocumentInfo *info = it.value();
+            usage += info->mDocument->memoryUsage();
             if (info->mDocument->ref == 1 && !info->mDocument->isModified()) {
-                unreferencedImages.insert(info->mLastAccess, it.key());
+                unreferencedImages.insert(info->retentionScore(), it.key());
             }
         }
 
-        // Remove oldest unreferenced images. Since the map is sorted by key,
-        // the oldest one is always unreferencedImages.begin().
-        for (UnreferencedImages::Iterator unreferencedIt = unreferencedImages.begin(); unreferencedImages.count() > MAX_UNREFERENCED_IMAGES;
+        const qint64 budget = memoryBudget(usage);
+        LOG("usage=" << usage << "budget=" << budget);
+
+        // Remove the least valuable unreferenced images. Since the map is
+        // sorted by key, the least valuable one is always
+        // unreferencedImages.begin().
+        for (UnreferencedImages::Iterator unreferencedIt = unreferencedImages.begin();
+             unreferencedIt != unreferencedImages.end()
+             && (usage > budget || (MAX_UNREFERENCED_IMAGES >= 0 && unreferencedImages.count() > MAX_UNREFERENCED_IMAGES));
              unreferencedIt = unreferencedImages.erase(unreferencedIt)) {
             const QUrl url = unreferencedIt.value();
             LOG("Collecting" << url);
             it = map.find(url);
             Q_ASSERT(it != map.end());
+            usage -= it.value()->mDocument->memoryUsage();
             delete it.value();
             map.erase(it);
         }
@@ -115,21 +170,40 @@ struct DocumentFactoryPrivate {
 #endif
     }
 
+    qint64 memoryUsage() const
+    {
+        qint64 usage = 0;
+        for (const DocumentInfo *info : mDocumentMap) {
+            usage += info->mDocument->memoryUsage();
+        }
+        return usage;
+    }
+
     void logDocumentMap(const DocumentMap &map)
     {
         LOG("map:");
         DocumentMap::ConstIterator it = map.constBegin(), end = map.constEnd();
         for (; it != end; ++it) {
-            LOG("-" << it.key() << "refCount=" << it.value()->mDocument.count() << "lastAccess=" << it.value()->mLastAccess);
+            LOG("-" << it.key() << "refCount=" << it.value()->mDocument->ref.loadRelaxed() << "lastAccess=" << it.value()->mLastAccess
+                    << "memoryUsage=" << it.value()->mDocument->memoryUsage() << "loadingCost=" << it.value()->mLoadingCost);
         }
     }
 
     QList<QUrl> mModifiedDocumentList;
+    QTimer mGarbageCollectTimer;
 };
 
 DocumentFactory::DocumentFactory()
     : d(new DocumentFactoryPrivate)
 {
+    // Documents grow once they are loaded, so we need to collect again then.
+    // Do it from the event loop so that we never delete a document while it
+    // is emitting a signal.
+    d->mGarbageCollectTimer.setSingleShot(true);
+    d->mGarbageCollectTimer.setInterval(0);
+    connect(&d->mGarbageCollectTimer, &QTimer::timeout, this, [this]() {
+        d->garbageCollect(d->mDocumentMap);
+    });
 }
 
 DocumentFactory::~DocumentFactory()
@@ -150,7 +224,7 @@ Document::Ptr DocumentFactory::getCachedDocument(const QUrl &url) const
     return info ? info->mDocument : Document::Ptr();
 }
 
-Document::Ptr DocumentFactory::load(const QUrl &url)
+Document::Ptr DocumentFactory::load(const QUrl &url, DecodeScheduler::Priority priority)
 {
     GV_RETURN_VALUE_IF_FAIL(!url.isEmpty(), Document::Ptr());
     DocumentInfo *info = nullptr;
@@ -161,6 +235,9 @@ Document::Ptr DocumentFactory::load(const QUrl &url)
         LOG(url.fileName() << "url in mDocumentMap");
         info = it.value();
         info->mLastAccess = QDateTime::currentDateTime();
+        if (priority < info->mDocument->decodePriority()) {
+            info->mDocument->setDecodePriority(priority);
+        }
         return info->mDocument;
     }
 
@@ -169,6 +246,7 @@ Document::Ptr DocumentFactory::load(const QUrl &url)
     // Start loading the document
     LOG(url.fileName() << "loading");
     auto doc = new Document(url);
+    doc->setDecodePriority(priority);
     connect(doc, &Document::loaded, this, &DocumentFactory::slotLoaded);
     connect(doc, &Document::saved, this, &DocumentFactory::slotSaved);
     connect(doc, &Document::modified, this, &DocumentFactory::slotModified);
@@ -195,6 +273,7 @@ Document::Ptr DocumentFactory::load(const QUrl &url)
     Document::Ptr docPtr(doc);
     info->mDocument = docPtr;
     info->mLastAccess = QDateTime::currentDateTime();
+    info->mLoadingTimer.start();
 
     // Place DocumentInfo in the map
     d->mDocumentMap[url] = info;
@@ -209,6 +288,12 @@ QList<QUrl> DocumentFactory::modifiedDocumentList() const
     return d->mModifiedDocumentList;
 }
 
+qint64 DocumentFactory::availableCacheMemory() const
+{
+    const qint64 usage = d->memoryUsage();
+    return memoryBudget(usage) - usage;
+}
+
 bool DocumentFactory::hasUrl(const QUrl &url) const
 {
     return d->mDocumentMap.contains(url);
@@ -223,6 +308,14 @@ void DocumentFactory::clearCache()
 
 void DocumentFactory::slotLoaded(const QUrl &url)
 {
+    DocumentInfo *info = d->mDocumentMap.value(url);
+    if (info && info->mLoadingTimer.isValid()) {
+        info->mLoadingCost = info->mLoadingTimer.elapsed();
+        info->mLoadingTimer.invalidate();
+        LOG(url.fileName() << "loaded in" << info->mLoadingCost << "ms");
+    }
+    d->mGarbageCollectTimer.start();
+
     if (d->mModifiedDocumentList.contains(url)) {
         d->mModifiedDocumentList.removeAll(url);
         Q_EMIT modifiedDocumentListChanged();
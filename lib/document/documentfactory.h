@@ -39,6 +39,10 @@ struct DocumentFactoryPrivate;
  * It keeps a cache of recently accessed documents to avoid reloading them.
  * To do so it keeps a last-access timestamp, which is updated to the
  * current time every time DocumentFactory::load() is called.
+ *
+ * Unreferenced documents are evicted once the cache uses more memory than
+ * allowed by GwenviewConfig::percentageOfMemoryForDocumentCache(). Documents
+ * which took longer to load are kept longer.
  */
 class GWENVIEWLIB_EXPORT DocumentFactory : public QObject
 {
@@ -51,8 +55,10 @@ public:
      * Loads the document associated with url, or returns an already cached
      * instance of Document::Ptr if there is any.
      * This method updates the last-access timestamp.
+     * The decode priority of the document is raised to @p priority if it is
+     * lower.
      */
-    Document::Ptr load(const QUrl &url);
+    Document::Ptr load(const QUrl &url, DecodeScheduler::Priority priority = DecodeScheduler::Background);
 
     /**
      * Returns a document if it has already been loaded once with load().
@@ -64,6 +70,13 @@ public:
 
     bool hasUrl(const QUrl &) const;
 
+    /**
+     * Returns how many more bytes documents can use before the cache starts
+     * evicting unreferenced documents. This is negative if documents already
+     * use more than the budget.
+     */
+    qint64 availableCacheMemory() const;
+
     void clearCache();
 
     QUndoGroup *undoGroup();
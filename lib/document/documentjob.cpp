@@ -25,13 +25,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #include <QApplication>
 #include <QFuture>
 #include <QFutureWatcher>
-#include <QtConcurrentRun>
 
 // KF
 #include <KDialogJobUiDelegate>
 #include <KLocalizedString>
 
 // Local
+#include "decodescheduler.h"
 #include "gwenview_lib_debug.h"
 
 namespace Gwenview
@@ -82,7 +82,7 @@ bool DocumentJob::checkDocumentEditor()
 
 void ThreadedDocumentJob::doStart()
 {
-    QFuture<void> future = QtConcurrent::run(&ThreadedDocumentJob::threadedStart, this);
+    QFuture<void> future = DecodeScheduler::instance()->run(document()->decodePriority(), &ThreadedDocumentJob::threadedStart, this);
     auto watcher = new QFutureWatcher<void>(this);
     connect(watcher, SIGNAL(finished()), SLOT(emitResult()));
     watcher->setFuture(future);
@@ -109,6 +109,12 @@ void DocumentLoadedImpl::setImage(const QImage &image)
     Q_EMIT imageRectUpdated(image.rect());
 }
 
+void DocumentLoadedImpl::updateImageRect(const QImage &image, const QRect &rect)
+{
+    updateDocumentImageRect(image, rect);
+    Q_EMIT imageRectUpdated(rect);
+}
+
 void DocumentLoadedImpl::applyTransformation(Orientation orientation)
 {
     QImage image = document()->image();
@@ -0,0 +1,286 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "imagepyramid.h"
+
+// Qt
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QList>
+#include <QThread>
+
+// Local
+#include "gwenview_lib_debug.h"
+
+namespace Gwenview
+{
+#undef ENABLE_LOG
+#undef LOG
+// #define ENABLE_LOG
+#ifdef ENABLE_LOG
+#define LOG(x) qCDebug(GWENVIEW_LIB_LOG) << x
+#else
+#define LOG(x) ;
+#endif
+
+/**
+ * Returns true if the format stores one byte per channel, in which case we
+ * can average channels without knowing their order
+ */
+static bool isBoxFilterFormat(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_Grayscale8:
+    case QImage::Format_RGB888:
+    case QImage::Format_BGR888:
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Fills @p destRect in @p dest with the average of the matching 2x2 pixel
+ * blocks of @p source. Pixels outside @p source are clamped to its edges.
+ */
+static void halveRect(const QImage &source, QImage *dest, const QRect &destRect)
+{
+    const int bytesPerPixel = source.depth() / 8;
+    const int lastX = source.width() - 1;
+    const int lastY = source.height() - 1;
+    for (int y = destRect.top(); y <= destRect.bottom(); ++y) {
+        const uchar *line0 = source.constScanLine(2 * y);
+        const uchar *line1 = source.constScanLine(qMin(2 * y + 1, lastY));
+        uchar *out = dest->scanLine(y) + destRect.left() * bytesPerPixel;
+        for (int x = destRect.left(); x <= destRect.right(); ++x) {
+            const int offset0 = 2 * x * bytesPerPixel;
+            const int offset1 = qMin(2 * x + 1, lastX) * bytesPerPixel;
+            for (int channel = 0; channel < bytesPerPixel; ++channel) {
+                *out++ = (line0[offset0 + channel] + line0[offset1 + channel] + line1[offset0 + channel] + line1[offset1 + channel] + 2) / 4;
+            }
+        }
+    }
+}
+
+static QImage halfImage(const QImage &image)
+{
+    const QSize size((image.width() + 1) / 2, (image.height() + 1) / 2);
+    if (!isBoxFilterFormat(image.format())) {
+        if (image.colorCount() > 0) {
+            return halfImage(image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32));
+        }
+        // Formats with more than 8 bits per channel are uncommon, let Qt deal
+        // with them
+        return image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    QImage result(size, image.format());
+    if (result.isNull()) {
+        qCWarning(GWENVIEW_LIB_LOG) << "Could not allocate image pyramid level of size" << size;
+        return {};
+    }
+    halveRect(image, &result, result.rect());
+    return result;
+}
+
+static QList<QImage> buildLevels(QImage image, int count)
+{
+    QList<QImage> levels;
+    for (int i = 0; i < count; ++i) {
+        image = halfImage(image);
+        if (image.isNull()) {
+            break;
+        }
+        levels << image;
+    }
+    return levels;
+}
+
+struct ImagePyramidPrivate {
+    QImage mImage;
+    // Levels 1 and up which have been built so far
+    QList<QImage> mLevels;
+    int mRequestedLevel = 0;
+
+    // Incremented each time the image changes, so that we can tell whether
+    // the levels being built are still valid
+    int mGeneration = 0;
+    int mBuildGeneration = 0;
+    int mBuildLevel = 0;
+    DecodeScheduler::Priority mPriority = DecodeScheduler::Background;
+    QFuture<QList<QImage>> mBuildFuture;
+    QFutureWatcher<QList<QImage>> mBuildFutureWatcher;
+
+    void startBuilding()
+    {
+        if (mBuildFuture.isRunning() || mLevels.size() >= mRequestedLevel || mImage.isNull()) {
+            return;
+        }
+        const QImage source = mLevels.isEmpty() ? mImage : mLevels.last();
+        const int count = mRequestedLevel - mLevels.size();
+        LOG("Building" << count << "level(s) from level" << mLevels.size());
+        mBuildGeneration = mGeneration;
+        mBuildLevel = mRequestedLevel;
+        mBuildFuture = DecodeScheduler::instance()->run(mPriority, &buildLevels, source, count);
+        mBuildFutureWatcher.setFuture(mBuildFuture);
+    }
+
+    void reset()
+    {
+        ++mGeneration;
+        mLevels.clear();
+        mRequestedLevel = 0;
+    }
+};
+
+ImagePyramid::ImagePyramid(QObject *parent)
+    : QObject(parent)
+    , d(new ImagePyramidPrivate)
+{
+    connect(&d->mBuildFutureWatcher, &QFutureWatcherBase::finished, this, &ImagePyramid::slotLevelsBuilt);
+}
+
+ImagePyramid::~ImagePyramid()
+{
+    // A running build only works on its own copies of the images, we do not
+    // need to wait for it
+    delete d;
+}
+
+void ImagePyramid::setImage(const QImage &image)
+{
+    if (QThread::currentThread() != thread()) {
+        // Image operations run on worker threads, while our thread reads the
+        // levels and gets the built ones
+        QMetaObject::invokeMethod(
+            this,
+            [this, image]() {
+                setImage(image);
+            },
+            Qt::QueuedConnection);
+        return;
+    }
+    d->mImage = image;
+    d->reset();
+}
+
+void ImagePyramid::updateImageRect(const QImage &image, const QRect &rect)
+{
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(
+            this,
+            [this, image, rect]() {
+                updateImageRect(image, rect);
+            },
+            Qt::QueuedConnection);
+        return;
+    }
+    if (image.size() != d->mImage.size() || d->mBuildFuture.isRunning() || !isBoxFilterFormat(image.format())) {
+        setImage(image);
+        return;
+    }
+    d->mImage = image;
+    QRect dirtyRect = rect.intersected(image.rect());
+    if (dirtyRect.isEmpty()) {
+        return;
+    }
+    QImage source = image;
+    for (QImage &level : d->mLevels) {
+        // Grow the rect so that it covers all the pixels affected by the
+        // source pixels
+        dirtyRect = QRect(QPoint(dirtyRect.left() / 2, dirtyRect.top() / 2), QPoint(dirtyRect.right() / 2, dirtyRect.bottom() / 2));
+        halveRect(source, &level, dirtyRect);
+        source = level;
+    }
+}
+
+int ImagePyramid::levelCount() const
+{
+    int count = 1;
+    for (int size = qMax(d->mImage.width(), d->mImage.height()); size > 1; size = (size + 1) / 2) {
+        ++count;
+    }
+    return count;
+}
+
+int ImagePyramid::levelForZoom(qreal zoom) const
+{
+    const int count = levelCount();
+    int level = 0;
+    while (level + 1 < count && zoom * (1 << (level + 1)) <= 1.) {
+        ++level;
+    }
+    return level;
+}
+
+const QImage &ImagePyramid::level(int level) const
+{
+    static const QImage sNullImage;
+    if (level == 0) {
+        return d->mImage;
+    }
+    if (level < 0 || level > d->mLevels.size()) {
+        return sNullImage;
+    }
+    return d->mLevels.at(level - 1);
+}
+
+bool ImagePyramid::prepareLevel(int level)
+{
+    if (level <= d->mLevels.size()) {
+        return true;
+    }
+    d->mRequestedLevel = qMax(d->mRequestedLevel, qMin(level, levelCount() - 1));
+    d->startBuilding();
+    return false;
+}
+
+const QImage &ImagePyramid::availableLevel(int level)
+{
+    prepareLevel(level);
+    level = qBound(0, level, d->mLevels.size());
+    return this->level(level);
+}
+
+qint64 ImagePyramid::memoryUsage() const
+{
+    qint64 usage = 0;
+    for (const QImage &level : qAsConst(d->mLevels)) {
+        usage += level.sizeInBytes();
+    }
+    return usage;
+}
+
+void ImagePyramid::setDecodePriority(DecodeScheduler::Priority priority)
+{
+    d->mPriority = priority;
+}
+
+void ImagePyramid::slotLevelsBuilt()
+{
+    const QList<QImage> levels = d->mBuildFuture.result();
+    if (d->mBuildGeneration != d->mGeneration) {
+        LOG("Image changed while building levels, dropping them");
+        d->startBuilding();
+        return;
+    }
+    const int firstLevel = d->mLevels.size() + 1;
+    d->mLevels << levels;
+    if (d->mLevels.size() < d->mBuildLevel) {
+        // Building failed, do not try again for this image
+        d->mRequestedLevel = d->mLevels.size();
+    }
+    for (int level = firstLevel; level <= d->mLevels.size(); ++level) {
+        Q_EMIT levelReady(level);
+    }
+    d->startBuilding();
+}
+
+} // namespace
+
+#include "moc_imagepyramid.cpp"
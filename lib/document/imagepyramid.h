@@ -0,0 +1,102 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <lib/decodescheduler.h>
+#include <lib/gwenviewlib_export.h>
+
+// Qt
+#include <QImage>
+#include <QObject>
+
+namespace Gwenview
+{
+struct ImagePyramidPrivate;
+
+/**
+ * Maintains down sampled versions of an image, each level being half the
+ * size of the previous one. Level 0 is the image itself.
+ *
+ * Levels are built lazily on a worker thread using a box filter: asking for a
+ * level which is not ready yet with prepareLevel() schedules its creation and
+ * levelReady() is emitted once it is available.
+ *
+ * setImage() and updateImageRect() may be called from any thread, the change
+ * is then applied asynchronously in the thread of the pyramid. Other methods
+ * must be called from that thread.
+ */
+class GWENVIEWLIB_EXPORT ImagePyramid : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ImagePyramid(QObject *parent = nullptr);
+    ~ImagePyramid() override;
+
+    /**
+     * Replaces the image, dropping all levels.
+     */
+    void setImage(const QImage &image);
+
+    /**
+     * Replaces the image with @p image, which must have the same size as the
+     * current one and may only differ from it inside @p rect. The levels
+     * which are already built are only updated for this region.
+     */
+    void updateImageRect(const QImage &image, const QRect &rect);
+
+    /**
+     * Returns the number of levels the image can have, including the image
+     * itself. The last level is 1 pixel wide or high.
+     */
+    int levelCount() const;
+
+    /**
+     * Returns the smallest level which is at least as large as the image
+     * zoomed by @p zoom. It is always less than twice as large.
+     */
+    int levelForZoom(qreal zoom) const;
+
+    /**
+     * Returns image for @p level, or a null image if it has not been built
+     * yet.
+     */
+    const QImage &level(int level) const;
+
+    /**
+     * Schedules building @p level if necessary.
+     * @return true if the level is already ready
+     */
+    bool prepareLevel(int level);
+
+    /**
+     * Schedules building @p level if necessary and returns the closest larger
+     * level which is already built, down to the image itself. Never scales
+     * on the calling thread: levelReady() is emitted as levels get built.
+     */
+    const QImage &availableLevel(int level);
+
+    /**
+     * Returns how many bytes are used by the down sampled levels
+     */
+    qint64 memoryUsage() const;
+
+    /**
+     * Sets the priority with which the next levels are built
+     */
+    void setDecodePriority(DecodeScheduler::Priority priority);
+
+Q_SIGNALS:
+    void levelReady(int level);
+
+private Q_SLOTS:
+    void slotLevelsBuilt();
+
+private:
+    ImagePyramidPrivate *const d;
+};
+
+} // namespace
+
+#endif /* IMAGEPYRAMID_H */
@@ -74,6 +74,12 @@ void JpegDocumentLoadedImpl::setImage(const QImage &image)
     DocumentLoadedImpl::setImage(image);
 }
 
+void JpegDocumentLoadedImpl::updateImageRect(const QImage &image, const QRect &rect)
+{
+    d->mJpegContent->setImage(image);
+    DocumentLoadedImpl::updateImageRect(image, rect);
+}
+
 void JpegDocumentLoadedImpl::applyTransformation(Orientation orientation)
 {
     DocumentLoadedImpl::applyTransformation(orientation);
@@ -48,6 +48,7 @@ protected:
 
     // AbstractDocumentEditor
     void setImage(const QImage &) override;
+    void updateImageRect(const QImage &image, const QRect &rect) override;
     void applyTransformation(Orientation orientation) override;
     //
 
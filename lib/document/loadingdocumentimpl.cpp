@@ -22,12 +22,14 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include "loadingdocumentimpl.h"
 
 // STL
+#include <cstring>
 #include <memory>
 
 // Exiv2
 #include <exiv2/exiv2.hpp>
 
 // Qt
+#include <QAtomicInt>
 #include <QBuffer>
 #include <QByteArray>
 #include <QColorSpace>
@@ -38,7 +40,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include <QImageReader>
 #include <QPointer>
 #include <QUrl>
-#include <QtConcurrent>
 
 // KF
 #include <KIO/TransferJob>
@@ -52,6 +53,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 // Local
 #include "animateddocumentloadedimpl.h"
 #include "cms/cmsprofile.h"
+#include "decodescheduler.h"
 #include "document.h"
 #include "documentloadedimpl.h"
 #include "emptydocumentimpl.h"
@@ -61,6 +63,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 #include "gwenviewconfig.h"
 #include "jpegcontent.h"
 #include "jpegdocumentloadedimpl.h"
+#include "mappedfile.h"
 #include "svgdocumentloadedimpl.h"
 #include "urlutils.h"
 #include "videodocumentloadedimpl.h"
@@ -78,6 +81,89 @@ namespace Gwenview
 
 const int HEADER_SIZE = 256;
 
+/**
+ * While a remote document is being transferred, we try to decode what we
+ * received so far once it has grown by this amount, or by half its size if
+ * that is bigger. This way the number of partial decodes stays logarithmic
+ * with the file size.
+ */
+const int MIN_PARTIAL_DECODE_STEP = 256 * 1024;
+
+/**
+ * Decodes the beginning of an image whose transfer is still running.
+ * libjpeg fills the missing part of a truncated image, so this gives us the
+ * first scanlines of a baseline JPEG, or a low quality version of the whole
+ * image for a progressive one.
+ */
+static QImage decodePartialImage(const QByteArray &data, const QByteArray &format)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer, format);
+    if (GwenviewConfig::applyExifOrientation()) {
+        reader.setAutoTransform(true);
+    }
+    return reader.read();
+}
+
+/**
+ * Images at least this large show their embedded preview while they are
+ * being decoded. Smaller ones decode fast enough for the preview to only
+ * flash.
+ */
+const qint64 PREVIEW_FIRST_MIN_PIXELS = 12 * 1000 * 1000;
+
+/**
+ * We use the smallest embedded preview which is at least this large, or the
+ * largest one if they are all smaller.
+ */
+const int PREVIEW_MIN_SIZE = 1024;
+
+/**
+ * A read-only device which stops delivering data once the load reading from
+ * it has been canceled. Image decoders pull their input in chunks, so this
+ * makes them bail out at their next read instead of decoding the whole
+ * image.
+ *
+ * This is not a QBuffer on purpose: some image handlers detect QBuffer and
+ * read its whole content at once, bypassing readData().
+ */
+class CancelableDevice : public QIODevice
+{
+public:
+    CancelableDevice(const QByteArray &data, const QAtomicInt *canceled)
+        : mData(data)
+        , mCanceled(canceled)
+    {
+    }
+
+    qint64 size() const override
+    {
+        return mData.size();
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        if (mCanceled->loadRelaxed()) {
+            return -1;
+        }
+        const qint64 length = qBound(qint64(0), qint64(mData.size()) - pos(), maxSize);
+        memcpy(data, mData.constData() + pos(), length);
+        return length;
+    }
+
+    qint64 writeData(const char *, qint64) override
+    {
+        return -1;
+    }
+
+private:
+    const QByteArray mData;
+    const QAtomicInt *mCanceled;
+};
+
 struct LoadingDocumentImplPrivate {
     LoadingDocumentImpl *q;
     QPointer<KIO::TransferJob> mTransferJob;
@@ -85,12 +171,28 @@ struct LoadingDocumentImplPrivate {
     QFutureWatcher<bool> mMetaInfoFutureWatcher;
     QFuture<void> mImageDataFuture;
     QFutureWatcher<void> mImageDataFutureWatcher;
+    QFuture<QImage> mPartialImageFuture;
+    QFutureWatcher<QImage> mPartialImageFutureWatcher;
 
     // If != 0, this means we need to load an image at zoom =
     // 1/mImageDataInvertedZoom
     int mImageDataInvertedZoom;
+    // Inverted zoom of the running, or last, image data load. Differs from
+    // mImageDataInvertedZoom when a new zoom has been requested while
+    // loading.
+    int mLoadingInvertedZoom;
+    // Set to make the running image data load give up
+    QAtomicInt mImageDataCanceled;
 
     bool mMetaInfoLoaded;
+    // True if we already emitted metaInfoLoaded() from the header of a
+    // document which is still being transferred
+    bool mHeaderLoaded;
+    // True if the document preview is a partial decode of a document which
+    // is still being transferred
+    bool mPartialImageLoaded;
+    // Length of mData when we last started a partial decode
+    int mPartialDataLength;
     bool mAnimated;
     bool mDownSampledImageLoaded;
     QByteArray mFormatHint;
@@ -100,9 +202,33 @@ struct LoadingDocumentImplPrivate {
     std::unique_ptr<Exiv2::Image> mExiv2Image;
     std::unique_ptr<JpegContent> mJpegContent;
     QImage mImage;
+    // Shown while the image is being decoded
+    QImage mPreviewImage;
+    // Set if the image is a RAW file to decode at full resolution
+    QString mRawPath;
     Cms::Profile::Ptr mCmsProfile;
+    // True if mCmsProfile must be read from the color space of the decoded
+    // image
+    bool mCmsProfileFromImage;
     QMimeType mMimeType;
 
+    /**
+     * Only raster images benefit from reading the file through a mapping:
+     * copy what we need and close the file for the other kinds
+     */
+    void releaseMapping(MimeTypeUtils::Kind kind)
+    {
+        if (!q->isMappedData(mData)) {
+            return;
+        }
+        if (kind == MimeTypeUtils::KIND_SVG_IMAGE) {
+            mData = QByteArray(mData.constData(), mData.size());
+        } else {
+            mData.clear();
+        }
+        q->setMappedFile(nullptr);
+    }
+
     /**
      * Determine kind of document and switch to an implementation if it is not
      * necessary to download more data.
@@ -123,6 +249,10 @@ struct LoadingDocumentImplPrivate {
         LOG("kind:" << kind);
         q->setDocumentKind(kind);
 
+        if (kind != MimeTypeUtils::KIND_RASTER_IMAGE) {
+            releaseMapping(kind);
+        }
+
         switch (kind) {
         case MimeTypeUtils::KIND_RASTER_IMAGE:
         case MimeTypeUtils::KIND_SVG_IMAGE:
@@ -140,6 +270,49 @@ struct LoadingDocumentImplPrivate {
         }
     }
 
+    /**
+     * Formats for which we can get the image size and a partially decoded
+     * image out of the first bytes of the file
+     */
+    bool supportsProgressiveLoading() const
+    {
+        return mMimeType.inherits(QStringLiteral("image/jpeg"));
+    }
+
+    /**
+     * Try to read the image size from the data received so far, so that views
+     * can be set up before the transfer is finished
+     */
+    void loadHeader()
+    {
+        QBuffer buffer(&mData);
+        buffer.open(QIODevice::ReadOnly);
+        QImageReader reader(&buffer, "jpeg");
+        QSize size = reader.size();
+        if (!size.isValid()) {
+            // Not enough data yet
+            return;
+        }
+        if (GwenviewConfig::applyExifOrientation() && reader.transformation().testFlag(QImageIOHandler::TransformationRotate90)) {
+            size.transpose();
+        }
+        LOG("Header loaded, size:" << size);
+        mImageSize = size;
+        mHeaderLoaded = true;
+        q->setDocumentFormat("jpeg");
+        q->setDocumentImageSize(size);
+        Q_EMIT q->metaInfoLoaded();
+    }
+
+    void startPartialImageLoading()
+    {
+        mPartialDataLength = mData.length();
+        // Pass mData by value: it is implicitly shared, so the worker keeps a
+        // stable copy while we keep appending to ours
+        mPartialImageFuture = DecodeScheduler::instance()->run(q->document()->decodePriority(), &decodePartialImage, mData, QByteArray("jpeg"));
+        mPartialImageFutureWatcher.setFuture(mPartialImageFuture);
+    }
+
     void startLoading()
     {
         Q_ASSERT(!mMetaInfoLoaded);
@@ -154,7 +327,7 @@ struct LoadingDocumentImplPrivate {
             //   https://bugs.kde.org/show_bug.cgi?id=289819
             //
             mFormatHint = mMimeType.preferredSuffix().toLocal8Bit().toLower();
-            mMetaInfoFuture = QtConcurrent::run(&LoadingDocumentImplPrivate::loadMetaInfo, this);
+            mMetaInfoFuture = DecodeScheduler::instance()->run(q->document()->decodePriority(), &LoadingDocumentImplPrivate::loadMetaInfo, this);
             mMetaInfoFutureWatcher.setFuture(mMetaInfoFuture);
             break;
 
@@ -177,7 +350,11 @@ struct LoadingDocumentImplPrivate {
         Q_ASSERT(mMetaInfoLoaded);
         Q_ASSERT(mImageDataInvertedZoom != 0);
         Q_ASSERT(!mImageDataFuture.isRunning());
-        mImageDataFuture = QtConcurrent::run(&LoadingDocumentImplPrivate::loadImageData, this);
+        mLoadingInvertedZoom = mImageDataInvertedZoom;
+        mImageDataCanceled.storeRelaxed(0);
+        mImage = QImage();
+        mAnimated = false;
+        mImageDataFuture = DecodeScheduler::instance()->run(q->document()->decodePriority(), &LoadingDocumentImplPrivate::loadImageData, this);
         mImageDataFutureWatcher.setFuture(mImageDataFuture);
     }
 
@@ -193,6 +370,17 @@ struct LoadingDocumentImplPrivate {
             mExiv2Image = loader.popImage();
         }
 
+        const bool isRaw = mMimeType.inherits(QStringLiteral("image/x-dcraw"));
+        if (mExiv2Image && GwenviewConfig::embeddedPreviewFirst()) {
+            // Exiv2 reads the previews from mData, do it before the RAW code
+            // below replaces it
+            const qint64 pixels = qint64(mExiv2Image->pixelWidth()) * mExiv2Image->pixelHeight();
+            if (isRaw || pixels >= PREVIEW_FIRST_MIN_PIXELS) {
+                mPreviewImage = Exiv2ImageLoader::loadEmbeddedPreview(mExiv2Image.get(), PREVIEW_MIN_SIZE, true);
+                LOG("Embedded preview size:" << mPreviewImage.size());
+            }
+        }
+
         QImageReader reader;
 
 #ifdef KDCRAW_FOUND
@@ -224,6 +412,11 @@ struct LoadingDocumentImplPrivate {
 
             // need to fill mFormat so gwenview can tell the type when trying to save
             mFormat = mFormatHint;
+
+            const QUrl url = q->document()->url();
+            if (GwenviewConfig::rawFullResolution() && url.isLocalFile()) {
+                mRawPath = url.toLocalFile();
+            }
         } else {
 #else
         {
@@ -276,34 +469,54 @@ struct LoadingDocumentImplPrivate {
             mCmsProfile = Cms::Profile::loadFromExiv2Image(mExiv2Image.get());
         }
 
+        if (!mRawPath.isEmpty()) {
+            // Until the full resolution image is decoded, the document has the
+            // size of the embedded JPEG. The full image is not a JPEG we could
+            // edit losslessly.
+            mJpegContent.reset();
+        }
+
         LOG("mImageSize" << mImageSize);
 
+        bool cmsProfileParsed = true;
         if (!mCmsProfile) {
-            mCmsProfile = Cms::Profile::loadFromImageData(mData, mFormat);
+            mCmsProfile = Cms::Profile::loadFromImageData(mData, mFormat, &cmsProfileParsed);
         }
 
-        if (!mCmsProfile && reader.canRead()) {
-            const QImage qtimage = reader.read();
-            if (!qtimage.isNull()) {
-                mCmsProfile = Cms::Profile::loadFromICC(qtimage.colorSpace().iccProfile());
-            }
-        }
+        // For other formats, or files we could not parse, we only learn about
+        // the profile by decoding the image. Do not decode it twice:
+        // loadImageData() picks the profile from its own decode.
+        mCmsProfileFromImage = !mCmsProfile && !cmsProfileParsed;
 
         return true;
     }
 
     void loadImageData()
     {
-        QBuffer buffer;
-        buffer.setBuffer(&mData);
-        buffer.open(QIODevice::ReadOnly);
-        QImageReader reader(&buffer, mFormat);
+#ifdef KDCRAW_FOUND
+        if (!mRawPath.isEmpty() && mLoadingInvertedZoom == 1) {
+            // Demosaicing takes seconds and cannot be canceled, only do it
+            // when the full image is needed. Down sampled images come from the
+            // embedded JPEG below.
+            LOG("Decoding RAW image at full resolution");
+            if (!KDcrawIface::KDcraw::loadFullImage(mImage, mRawPath)) {
+                qCWarning(GWENVIEW_LIB_LOG) << "Unable to decode RAW image" << mRawPath;
+                mImage = QImage();
+                return;
+            }
+            mImageSize = mImage.size();
+            return;
+        }
+#endif
+        CancelableDevice device(mData, &mImageDataCanceled);
+        device.open(QIODevice::ReadOnly);
+        QImageReader reader(&device, mFormat);
 
-        LOG("mImageDataInvertedZoom=" << mImageDataInvertedZoom);
-        if (mImageSize.isValid() && mImageDataInvertedZoom != 1 && reader.supportsOption(QImageIOHandler::ScaledSize)) {
+        LOG("mLoadingInvertedZoom=" << mLoadingInvertedZoom);
+        if (mImageSize.isValid() && mLoadingInvertedZoom != 1 && reader.supportsOption(QImageIOHandler::ScaledSize)) {
             // Do not use mImageSize here: QImageReader needs a non-transposed
             // image size
-            QSize size = reader.size() / mImageDataInvertedZoom;
+            QSize size = reader.size() / mLoadingInvertedZoom;
             if (!size.isEmpty()) {
                 LOG("Setting scaled size to" << size);
                 reader.setScaledSize(size);
@@ -322,6 +535,11 @@ struct LoadingDocumentImplPrivate {
             return;
         }
 
+        if (mCmsProfileFromImage) {
+            mCmsProfile = Cms::Profile::loadFromICC(mImage.colorSpace().iccProfile());
+            mCmsProfileFromImage = false;
+        }
+
         if (reader.supportsAnimation() && reader.nextImageDelay() > 0 // Assume delay == 0 <=> only one frame
         ) {
             /*
@@ -353,13 +571,20 @@ LoadingDocumentImpl::LoadingDocumentImpl(Document *document)
 {
     d->q = this;
     d->mMetaInfoLoaded = false;
+    d->mHeaderLoaded = false;
+    d->mPartialImageLoaded = false;
+    d->mPartialDataLength = 0;
     d->mAnimated = false;
     d->mDownSampledImageLoaded = false;
+    d->mCmsProfileFromImage = false;
     d->mImageDataInvertedZoom = 0;
+    d->mLoadingInvertedZoom = 0;
 
     connect(&d->mMetaInfoFutureWatcher, &QFutureWatcherBase::finished, this, &LoadingDocumentImpl::slotMetaInfoLoaded);
 
     connect(&d->mImageDataFutureWatcher, &QFutureWatcherBase::finished, this, &LoadingDocumentImpl::slotImageLoaded);
+
+    connect(&d->mPartialImageFutureWatcher, &QFutureWatcherBase::finished, this, &LoadingDocumentImpl::slotPartialImageLoaded);
 }
 
 LoadingDocumentImpl::~LoadingDocumentImpl()
@@ -368,9 +593,12 @@ LoadingDocumentImpl::~LoadingDocumentImpl()
     // Disconnect watchers to make sure they do not trigger further work
     d->mMetaInfoFutureWatcher.disconnect();
     d->mImageDataFutureWatcher.disconnect();
+    d->mPartialImageFutureWatcher.disconnect();
 
+    d->mImageDataCanceled.storeRelaxed(1);
     d->mMetaInfoFutureWatcher.waitForFinished();
     d->mImageDataFutureWatcher.waitForFinished();
+    d->mPartialImageFutureWatcher.waitForFinished();
 
     if (d->mTransferJob) {
         d->mTransferJob->kill();
@@ -383,6 +611,19 @@ void LoadingDocumentImpl::init()
     QUrl url = document()->url();
 
     if (UrlUtils::urlIsFastLocalFile(url)) {
+        // Map the file instead of reading it: decoders then read straight
+        // from the page cache and we never hold a heap copy of the file
+        const MappedFile::Ptr mappedFile = MappedFile::map(url.toLocalFile());
+        if (mappedFile) {
+            setMappedFile(mappedFile);
+            d->mData = mappedFile->data();
+            if (d->determineKind()) {
+                return;
+            }
+            d->startLoading();
+            return;
+        }
+
         // Load file content directly
         QFile file(url.toLocalFile());
         if (!file.open(QIODevice::ReadOnly)) {
@@ -416,9 +657,16 @@ void LoadingDocumentImpl::loadImage(int invertedZoom)
         LOG("Ignoring request: we are loading a full image");
         return;
     }
-    d->mImageDataFutureWatcher.waitForFinished();
     d->mImageDataInvertedZoom = invertedZoom;
 
+    if (d->mImageDataFuture.isRunning()) {
+        // Do not block waiting for a load we no longer need: make it give up,
+        // slotImageLoaded() starts the new one when it is done
+        LOG("Superseding load at invertedZoom=" << d->mLoadingInvertedZoom);
+        d->mImageDataCanceled.storeRelaxed(1);
+        return;
+    }
+
     if (d->mMetaInfoLoaded) {
         // Do not test on mMetaInfoFuture.isRunning() here: it might not have
         // started if we are downloading the image from a remote url
@@ -435,6 +683,18 @@ void LoadingDocumentImpl::slotDataReceived(KIO::Job *job, const QByteArray &chun
             return;
         }
     }
+
+    if (document()->kind() != MimeTypeUtils::KIND_RASTER_IMAGE || !d->supportsProgressiveLoading()) {
+        return;
+    }
+    if (!d->mHeaderLoaded) {
+        d->loadHeader();
+        return;
+    }
+    const int step = qMax(MIN_PARTIAL_DECODE_STEP, d->mPartialDataLength / 2);
+    if (!d->mPartialImageFuture.isRunning() && d->mData.length() >= d->mPartialDataLength + step) {
+        d->startPartialImageLoading();
+    }
 }
 
 void LoadingDocumentImpl::slotTransferFinished(KJob *job)
@@ -463,7 +723,7 @@ Document::LoadingState LoadingDocumentImpl::loadingState() const
 {
     if (!document()->image().isNull()) {
         return Document::Loaded;
-    } else if (d->mMetaInfoLoaded) {
+    } else if (d->mMetaInfoLoaded || d->mHeaderLoaded) {
         return Document::MetaInfoLoaded;
     } else if (document()->kind() != MimeTypeUtils::KIND_UNKNOWN) {
         return Document::KindDetermined;
@@ -487,9 +747,20 @@ void LoadingDocumentImpl::slotMetaInfoLoaded()
     setDocumentImageSize(d->mImageSize);
     setDocumentExiv2Image(std::move(d->mExiv2Image));
     setDocumentCmsProfile(d->mCmsProfile);
+    setDocumentFullImageLoadingSlow(!d->mRawPath.isEmpty());
+    if (!d->mPreviewImage.isNull()) {
+        // A partial image decoded from most of the data beats the embedded
+        // preview
+        if (!d->mPartialImageLoaded) {
+            setDocumentPreviewImage(d->mPreviewImage);
+        }
+        d->mPreviewImage = QImage();
+    }
 
     d->mMetaInfoLoaded = true;
-    Q_EMIT metaInfoLoaded();
+    if (!d->mHeaderLoaded) {
+        Q_EMIT metaInfoLoaded();
+    }
 
     // Start image loading if necessary
     // We test if mImageDataFuture is not already running because code connected to
@@ -502,6 +773,15 @@ void LoadingDocumentImpl::slotMetaInfoLoaded()
 void LoadingDocumentImpl::slotImageLoaded()
 {
     LOG("");
+    // Restart if we have been superseded, or canceled before being asked
+    // again for the same zoom. Decoders may return a partial image when
+    // their input stops, never keep the result of a canceled load.
+    if (d->mLoadingInvertedZoom != d->mImageDataInvertedZoom || d->mImageDataCanceled.loadRelaxed()) {
+        LOG("Load at invertedZoom=" << d->mLoadingInvertedZoom << "superseded by invertedZoom=" << d->mImageDataInvertedZoom);
+        d->startImageDataLoading();
+        return;
+    }
+
     if (d->mImage.isNull()) {
         setDocumentErrorString(i18nc("@info", "Loading image failed."));
         Q_EMIT loadingFailed();
@@ -509,6 +789,11 @@ void LoadingDocumentImpl::slotImageLoaded()
         return;
     }
 
+    if (d->mCmsProfile && d->mCmsProfile != document()->cmsProfile()) {
+        // The profile came with the decoded image
+        setDocumentCmsProfile(d->mCmsProfile);
+    }
+
     if (d->mAnimated) {
         if (d->mImage.size() == d->mImageSize) {
             // We already decoded the first frame at the right size, let's show
@@ -521,15 +806,21 @@ void LoadingDocumentImpl::slotImageLoaded()
         return;
     }
 
-    if (d->mImageDataInvertedZoom != 1 && d->mImage.size() != d->mImageSize) {
+    if (d->mLoadingInvertedZoom != 1 && d->mImage.size() != d->mImageSize) {
         LOG("Loaded a down sampled image");
         d->mDownSampledImageLoaded = true;
+        if (d->mPartialImageLoaded) {
+            // The down sampled image is complete, unlike the partial one
+            d->mPartialImageLoaded = false;
+            setDocumentPreviewImage(QImage());
+        }
         // We loaded a down sampled image
-        setDocumentDownSampledImage(d->mImage, d->mImageDataInvertedZoom);
+        setDocumentDownSampledImage(d->mImage, d->mLoadingInvertedZoom);
         return;
     }
 
     LOG("Loaded a full image");
+    d->mPartialImageLoaded = false;
     setDocumentImage(d->mImage);
     DocumentLoadedImpl *impl;
     if (d->mJpegContent.get()) {
@@ -540,6 +831,24 @@ void LoadingDocumentImpl::slotImageLoaded()
     switchToImpl(impl);
 }
 
+void LoadingDocumentImpl::slotPartialImageLoaded()
+{
+    if (d->mMetaInfoLoaded) {
+        // Transfer is over, the real decoding has taken over
+        return;
+    }
+    const QImage image = d->mPartialImageFuture.result();
+    if (image.isNull() || image.size() != d->mImageSize) {
+        LOG("Could not decode a usable partial image");
+        return;
+    }
+    LOG("Loaded a partial image from" << d->mPartialDataLength << "bytes");
+    // Show it as a preview: it must not end up in the image pyramid, nor make
+    // the document look loaded
+    d->mPartialImageLoaded = true;
+    setDocumentPreviewImage(image);
+}
+
 } // namespace
 
 #include "moc_loadingdocumentimpl.cpp"
@@ -53,6 +53,7 @@ public:
 private Q_SLOTS:
     void slotMetaInfoLoaded();
     void slotImageLoaded();
+    void slotPartialImageLoaded();
     void slotDataReceived(KIO::Job *, const QByteArray &);
     void slotTransferFinished(KJob *);
 
@@ -29,7 +29,6 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #include <QScopedPointer>
 #include <QTemporaryFile>
 #include <QUrl>
-#include <QtConcurrentRun>
 
 // KF
 #include <KIO/CopyJob>
@@ -38,6 +37,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #include <KLocalizedString>
 
 // Local
+#include "decodescheduler.h"
 #include "documentloadedimpl.h"
 
 namespace Gwenview
@@ -110,7 +110,7 @@ void SaveJob::doStart()
         emitResult();
         return;
     }
-    QFuture<void> future = QtConcurrent::run(&SaveJob::saveInternal, this);
+    QFuture<void> future = DecodeScheduler::instance()->run(document()->decodePriority(), &SaveJob::saveInternal, this);
     d->mInternalSaveWatcher.reset(new QFutureWatcher<void>(this));
     connect(d->mInternalSaveWatcher.data(), &QFutureWatcherBase::finished, this, &SaveJob::finishSave);
     d->mInternalSaveWatcher->setFuture(future);
@@ -129,6 +129,18 @@ struct DocumentViewPrivate {
 #endif
     int mMinTimeBetweenPinch;
 
+    DecodeScheduler::Priority decodePriority() const
+    {
+        return mCompareMode && !mCurrent ? DecodeScheduler::CompareView : DecodeScheduler::CurrentView;
+    }
+
+    void updateDecodePriority()
+    {
+        if (mDocument) {
+            mDocument->setDecodePriority(decodePriority());
+        }
+    }
+
     void setCurrentAdapter(AbstractDocumentViewAdapter *adapter)
     {
         Q_ASSERT(adapter);
@@ -558,6 +570,8 @@ void DocumentView::openUrl(const QUrl &url, const DocumentView::Setup &setup)
             return;
         }
         disconnect(d->mDocument.data(), nullptr, this, nullptr);
+        // We are leaving it, most likely for one of its neighbours
+        d->mDocument->setDecodePriority(DecodeScheduler::Preload);
     }
 
     // because some loading will be going on right now, also display the indicator after a small delay
@@ -565,7 +579,7 @@ void DocumentView::openUrl(const QUrl &url, const DocumentView::Setup &setup)
     d->showLoadingIndicator();
 
     d->mSetup = setup;
-    d->mDocument = DocumentFactory::instance()->load(url);
+    d->mDocument = DocumentFactory::instance()->load(url, d->decodePriority());
     connect(d->mDocument.data(), &Document::busyChanged, this, &DocumentView::slotBusyChanged);
     connect(d->mDocument.data(), &Document::modified, this, [this]() {
         d->updateZoomSnapValues();
@@ -982,6 +996,7 @@ qreal DocumentView::minimumZoom() const
 void DocumentView::setCompareMode(bool compare)
 {
     d->mCompareMode = compare;
+    d->updateDecodePriority();
     if (compare) {
         d->mHud->show();
         d->mHud->setZValue(1);
@@ -993,6 +1008,7 @@ void DocumentView::setCompareMode(bool compare)
 void DocumentView::setCurrent(bool value)
 {
     d->mCurrent = value;
+    d->updateDecodePriority();
     if (value) {
         d->mAdapter->widget()->setFocus();
         d->updateCaption();
@@ -25,33 +25,125 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #include <QGraphicsScene>
 #include <QGraphicsView>
 #include <QPainter>
+#include <QtConcurrent>
 
 #include "gvdebug.h"
 #include "lib/cms/cmsprofile.h"
+#include "lib/document/imagepyramid.h"
 #include "rasterimageview.h"
 
 using namespace Gwenview;
 
-// Convenience constants for one third and one sixth.
-static const qreal Third = 1.0 / 3.0;
-static const qreal Sixth = 1.0 / 6.0;
+// Size of the tiles, in device pixels of the zoomed image.
+static const int TileSize = 256;
 
-RasterImageItem::RasterImageItem(Gwenview::RasterImageView *parent)
-    : QGraphicsItem(parent)
-    , mParentView(parent)
+// Maximum amount of memory used by rendered tiles, in kilobytes. This is
+// enough to hold a couple of 4K screens worth of tiles.
+static const int TileCacheSize = 128 * 1024;
+
+namespace
 {
+struct Tile {
+    QPoint position;
+    QRect rect;
+    QImage image;
+};
 }
 
-RasterImageItem::~RasterImageItem()
+/**
+ * Returns the format tiles rendered from @p source will use: indexed color
+ * and premultiplied alpha are not supported by the color correction engine.
+ */
+static QImage::Format displayFormatForImage(const QImage &source)
 {
-    if (mDisplayTransform) {
-        cmsDeleteTransform(mDisplayTransform);
+    if (source.colorCount() > 0) {
+        return source.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32;
+    }
+    switch (source.format()) {
+    case QImage::Format_ARGB32_Premultiplied:
+        return QImage::Format_ARGB32;
+    case QImage::Format_RGBA8888_Premultiplied:
+        return QImage::Format_RGBA8888;
+    case QImage::Format_RGBA64_Premultiplied:
+        return QImage::Format_RGBA64;
+    // TODO convert formats not supported by LittleCMS?
+    default:
+        return source.format();
     }
 }
 
+/**
+ * Renders the part of the zoomed image covered by @p tileRect. @p source is
+ * either the image or a down sampled version of it.
+ *
+ * This is called from worker threads.
+ */
+static QImage renderTile(const QImage &source,
+                         const QSize &imageSize,
+                         const QRect &tileRect,
+                         qreal zoom,
+                         QImage::Format format,
+                         const Cms::DisplayTransform *transform)
+{
+    // Zoom to apply to the source to get the zoomed image
+    const qreal zoomX = zoom * imageSize.width() / source.width();
+    const qreal zoomY = zoom * imageSize.height() / source.height();
+
+    // Copy the source area covering the tile into a new image. This allows us
+    // to modify the resulting image without affecting the original image
+    // data. Add a one pixel margin so that smooth scaling does not produce
+    // visible seams between tiles.
+    const QRect sourceRect = QRect(QPoint(std::floor(tileRect.left() / zoomX) - 1, std::floor(tileRect.top() / zoomY) - 1),
+                                   QPoint(std::ceil((tileRect.right() + 1) / zoomX), std::ceil((tileRect.bottom() + 1) / zoomY)))
+                                 .intersected(source.rect());
+    QImage image = source.copy(sourceRect);
+
+    // We want nearest neighbour at high zoom since that provides the most
+    // accurate representation of pixels, but at low zoom or when zooming out it
+    // will not look very nice, so use smoothing instead. Switch at an arbitrary
+    // threshold of 400% zoom
+    const auto transformationMode = zoom < 4.0 ? Qt::SmoothTransformation : Qt::FastTransformation;
+
+    // Scale the source area to the requested zoom, then crop it to the tile.
+    image = image.scaled(qRound(sourceRect.width() * zoomX), qRound(sourceRect.height() * zoomY), Qt::IgnoreAspectRatio, transformationMode);
+    const QPoint offset = QPoint(qRound(tileRect.left() - sourceRect.left() * zoomX), qRound(tileRect.top() - sourceRect.top() * zoomY));
+    image = image.copy(QRect(offset, tileRect.size()).intersected(image.rect()));
+
+    // We may load an image in indexed color or premultiplied alpha, or scaling may produce premultiplied alpha.
+    // These are not supported by the color correction engine, so convert to a standard format.
+    if (image.format() != format) {
+        image.convertTo(format);
+    }
+
+    // Perform color correction on the tile.
+    if (transform) {
+        transform->apply(&image);
+    }
+
+    return image;
+}
+
+RasterImageItem::RasterImageItem(Gwenview::RasterImageView *parent)
+    : QGraphicsItem(parent)
+    , mParentView(parent)
+{
+    mTileCache.setMaxCost(TileCacheSize);
+}
+
+RasterImageItem::~RasterImageItem() = default;
+
 void RasterImageItem::setRenderingIntent(RenderingIntent::Enum intent)
 {
     mRenderingIntent = intent;
+    resetDisplayTransform();
+    update();
+}
+
+void RasterImageItem::resetMonitorProfile()
+{
+    Cms::DisplayTransform::resetMonitorProfile();
+    ++mMonitorProfileId;
+    resetDisplayTransform();
     update();
 }
 
@@ -60,20 +152,23 @@ void Gwenview::RasterImageItem::updateCache()
     auto document = mParentView->document();
 
     // Save a shallow copy of the image to make sure that it will not get
-    // destroyed by another thread.
+    // destroyed by another thread. Until the image is decoded, show its
+    // preview scaled to the document size.
     mOriginalImage = document->image();
+    if (mOriginalImage.isNull()) {
+        mOriginalImage = document->previewImage();
+    }
+    mImageSize = document->size();
 
-    // Cache two scaled down versions of the image, one at a third of the size
-    // and one at a sixth. These are used instead of the document image at small
-    // zoom levels, to avoid having to copy around the entire image which can be
-    // very slow for large images.
-    mThirdScaledImage = mOriginalImage.scaled(document->size() * Third, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
-    mSixthScaledImage = mOriginalImage.scaled(document->size() * Sixth, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    // The image, its color profile or the available pyramid levels may have
+    // changed
+    mTileCache.clear();
+    resetDisplayTransform();
 }
 
 void RasterImageItem::paint(QPainter *painter, const QStyleOptionGraphicsItem * /*option*/, QWidget * /*widget*/)
 {
-    if (mOriginalImage.isNull() || mThirdScaledImage.isNull() || mSixthScaledImage.isNull()) {
+    if (mOriginalImage.isNull()) {
         return;
     }
 
@@ -95,70 +190,57 @@ void RasterImageItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *
 
     // Constrain the visible area rect by the image's rect so we don't try to
     // copy pixels that are outside the image.
-    imageRect = imageRect.intersected(mOriginalImage.rect());
+    imageRect = imageRect.intersected(QRect(QPoint(0, 0), mImageSize));
 
-    QImage image;
-    qreal targetZoom = zoom;
-
-    // Copy the visible area from the document's image into a new image. This
-    // allows us to modify the resulting image without affecting the original
-    // image data. If we are zoomed out far enough, we instead use one of the
-    // cached scaled copies to avoid having to copy a lot of data.
-    if (zoom > Third) {
-        image = mOriginalImage.copy(imageRect);
-    } else if (zoom > Sixth) {
-        auto sourceRect = QRect{imageRect.topLeft() * Third, imageRect.size() * Third};
-        targetZoom = zoom / Third;
-        image = mThirdScaledImage.copy(sourceRect);
-    } else {
-        auto sourceRect = QRect{imageRect.topLeft() * Sixth, imageRect.size() * Sixth};
-        targetZoom = zoom / Sixth;
-        image = mSixthScaledImage.copy(sourceRect);
+    // Find the visible area in the zoomed image, and the tiles covering it.
+    const QRect zoomedImageRect = QRect(QPoint(0, 0), mImageSize * zoom);
+    const QRect visibleRect = QRectF(imageRect.topLeft() * zoom, QSizeF(imageRect.size()) * zoom).toAlignedRect().intersected(zoomedImageRect);
+    if (visibleRect.isEmpty()) {
+        return;
     }
 
-    const bool isIndexedColor = image.colorCount() > 0;
-
-    QImage::Format outputImageFormat = image.format();
-    if (isIndexedColor) {
-        outputImageFormat = image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32;
-    } else {
-        switch (outputImageFormat) {
-        case QImage::Format_ARGB32_Premultiplied:
-            outputImageFormat = QImage::Format_ARGB32;
-            break;
-        case QImage::Format_RGBA8888_Premultiplied:
-            outputImageFormat = QImage::Format_RGBA8888;
-            break;
-        case QImage::Format_RGBA64_Premultiplied:
-            outputImageFormat = QImage::Format_RGBA64;
-            break;
-        // TODO convert formats not supported by LittleCMS?
-        default:;
+    RasterImageTileKey key{zoom, QPoint(), mRenderingIntent, mMonitorProfileId};
+    QList<Tile> tiles;
+    bool hasMissingTiles = false;
+    for (int tileY = visibleRect.top() / TileSize; tileY <= visibleRect.bottom() / TileSize; ++tileY) {
+        for (int tileX = visibleRect.left() / TileSize; tileX <= visibleRect.right() / TileSize; ++tileX) {
+            Tile tile;
+            tile.position = QPoint(tileX, tileY);
+            tile.rect = QRect(tileX * TileSize, tileY * TileSize, TileSize, TileSize).intersected(zoomedImageRect);
+            key.tile = tile.position;
+            // Take a shallow copy of the tile: inserting the missing ones may
+            // evict it from the cache
+            if (const QImage *cachedTile = mTileCache.object(key)) {
+                tile.image = *cachedTile;
+            } else {
+                hasMissingTiles = true;
+            }
+            tiles << tile;
         }
     }
 
-    // We want nearest neighbour at high zoom since that provides the most
-    // accurate representation of pixels, but at low zoom or when zooming out it
-    // will not look very nice, so use smoothing instead. Switch at an arbitrary
-    // threshold of 400% zoom
-    const auto transformationMode = zoom < 4.0 ? Qt::SmoothTransformation : Qt::FastTransformation;
-
-    // Scale the visible image to the requested zoom.
-    image = image.scaled(image.size() * targetZoom, Qt::IgnoreAspectRatio, transformationMode);
-
-    // We may load an image in indexed color or premultiplied alpha, or scaling may produce premultiplied alpha.
-    // These are not supported by the color correction engine, so convert to a standard format.
-    if (image.format() != outputImageFormat) {
-        image.convertTo(outputImageFormat);
+    if (hasMissingTiles) {
+        // Render the missing tiles in parallel
+        const QImage source = sourceForZoom(zoom);
+        const QImage::Format format = displayFormatForImage(source);
+        const Cms::DisplayTransform::Ptr transform = displayTransform(format);
+        const QSize imageSize = mImageSize;
+        QtConcurrent::blockingMap(tiles, [&source, &imageSize, zoom, format, &transform](Tile &tile) {
+            if (tile.image.isNull()) {
+                tile.image = renderTile(source, imageSize, tile.rect, zoom, format, transform.get());
+            }
+        });
     }
 
-    // Perform color correction on the visible image.
-    applyDisplayTransform(image);
-
-    const auto destinationRect = QRectF{QPointF{std::ceil(imageRect.left() * (zoom / dpr)), std::ceil(imageRect.top() * (zoom / dpr))},
-                                        QSizeF{image.size().width() / dpr, image.size().height() / dpr}};
+    for (const Tile &tile : qAsConst(tiles)) {
+        key.tile = tile.position;
+        if (!mTileCache.contains(key)) {
+            mTileCache.insert(key, new QImage(tile.image), qMax(1, int(tile.image.sizeInBytes() / 1024)));
+        }
 
-    painter->drawImage(destinationRect, image);
+        const auto destinationRect = QRectF{QPointF(tile.rect.topLeft()) / dpr, QSizeF(tile.image.size()) / dpr};
+        painter->drawImage(destinationRect, tile.image);
+    }
 }
 
 QRectF RasterImageItem::boundingRect() const
@@ -166,28 +248,24 @@ QRectF RasterImageItem::boundingRect() const
     return QRectF{QPointF{0, 0}, mParentView->documentSize() * mParentView->zoom()};
 }
 
-void RasterImageItem::applyDisplayTransform(QImage &image)
+QImage RasterImageItem::sourceForZoom(qreal zoom)
 {
-    if (mApplyDisplayTransform) {
-        updateDisplayTransform(image.format());
-        if (mDisplayTransform) {
-            quint8 *bytes = image.bits();
-            cmsDoTransform(mDisplayTransform, bytes, bytes, image.width() * image.height());
-        }
+    // If we are zoomed out, use a level of the image pyramid to avoid having
+    // to copy and scale a lot of data. If the level is not ready yet, fall back
+    // to the closest larger one which is, we will be repainted when it is.
+    ImagePyramid *pyramid = mParentView->document()->imagePyramid();
+    int level = pyramid->levelForZoom(zoom);
+    if (level > 0 && pyramid->level(0).cacheKey() == mOriginalImage.cacheKey()) {
+        return pyramid->availableLevel(level);
     }
+    return mOriginalImage;
 }
 
-void RasterImageItem::updateDisplayTransform(QImage::Format format)
+Cms::DisplayTransform::Ptr RasterImageItem::displayTransform(QImage::Format format)
 {
-    if (format == QImage::Format_Invalid) {
-        return;
-    }
-
-    mApplyDisplayTransform = false;
-    if (mDisplayTransform) {
-        cmsDeleteTransform(mDisplayTransform);
+    if (format == mDisplayTransformFormat) {
+        return mDisplayTransform;
     }
-    mDisplayTransform = nullptr;
 
     Cms::Profile::Ptr profile = mParentView->document()->cmsProfile();
     if (!profile) {
@@ -195,44 +273,16 @@ void RasterImageItem::updateDisplayTransform(QImage::Format format)
         // has a wide-gamut screen.
         profile = Cms::Profile::getSRgbProfile();
     }
-    Cms::Profile::Ptr monitorProfile = Cms::Profile::getMonitorProfile();
-    if (!monitorProfile) {
-        qCWarning(GWENVIEW_LIB_LOG) << "Could not get monitor color profile";
-        return;
-    }
 
-    cmsUInt32Number cmsFormat = 0;
-    switch (format) {
-    case QImage::Format_RGB32:
-    case QImage::Format_ARGB32:
-        cmsFormat = TYPE_BGRA_8;
-        break;
-    case QImage::Format_Grayscale8:
-        cmsFormat = TYPE_GRAY_8;
-        break;
-    case QImage::Format_RGB888:
-        cmsFormat = TYPE_RGB_8;
-        break;
-    case QImage::Format_RGBX8888:
-    case QImage::Format_RGBA8888:
-        cmsFormat = TYPE_RGBA_8;
-        break;
-    case QImage::Format_Grayscale16:
-        cmsFormat = TYPE_GRAY_16;
-        break;
-    case QImage::Format_RGBA64:
-    case QImage::Format_RGBX64:
-        cmsFormat = TYPE_RGBA_16;
-        break;
-    case QImage::Format_BGR888:
-        cmsFormat = TYPE_BGR_8;
-        break;
-    default:
-        qCWarning(GWENVIEW_LIB_LOG) << "Gwenview cannot apply color profile on" << format << "images";
-        return;
-    }
+    // Remember the format even if we fail, so that we do not try again for
+    // every paint
+    mDisplayTransformFormat = format;
+    mDisplayTransform = Cms::DisplayTransform::create(profile, format, mRenderingIntent);
+    return mDisplayTransform;
+}
 
-    mDisplayTransform =
-        cmsCreateTransform(profile->handle(), cmsFormat, monitorProfile->handle(), cmsFormat, mRenderingIntent, cmsFLAGS_BLACKPOINTCOMPENSATION);
-    mApplyDisplayTransform = true;
+void RasterImageItem::resetDisplayTransform()
+{
+    mDisplayTransform.reset();
+    mDisplayTransformFormat = QImage::Format_Invalid;
 }
@@ -21,14 +21,37 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #ifndef RASTERIMAGEITEM_H
 #define RASTERIMAGEITEM_H
 
+#include <QCache>
 #include <QGraphicsItem>
 
+#include "lib/cms/cmsdisplaytransform.h"
 #include "lib/renderingintent.h"
 
 namespace Gwenview
 {
 class RasterImageView;
 
+/**
+ * Identifies a tile of the image, rendered at a given zoom with a given color
+ * transform.
+ */
+struct RasterImageTileKey {
+    qreal zoom;
+    QPoint tile;
+    cmsUInt32Number renderingIntent;
+    int monitorProfileId;
+
+    bool operator==(const RasterImageTileKey &other) const
+    {
+        return zoom == other.zoom && tile == other.tile && renderingIntent == other.renderingIntent && monitorProfileId == other.monitorProfileId;
+    }
+};
+
+inline size_t qHash(const RasterImageTileKey &key, size_t seed = 0)
+{
+    return qHashMulti(seed, key.zoom, key.tile.x(), key.tile.y(), key.renderingIntent, key.monitorProfileId);
+}
+
 /**
  * A QGraphicsItem subclass responsible for rendering the main raster image.
  *
@@ -37,9 +60,14 @@ class RasterImageView;
  * this based on the values from the parent ImageView, then apply color
  * correction. Finally the result will be drawn to the screen.
  *
- * For performance, two extra images are cached, one at a third of the image
- * size and one at a sixth. These are used at low zoom levels, to avoid having
- * to copy large amounts of image data that later gets discarded.
+ * The visible area is split in tiles of the zoomed image. Tiles are kept
+ * scaled and color corrected in a cache, so repainting or panning only has to
+ * render the tiles which were not visible before. Missing tiles are rendered
+ * in parallel on the global thread pool.
+ *
+ * At low zoom levels, tiles are rendered from the document image pyramid, using
+ * the smallest level which is larger than the zoomed image. This avoids having
+ * to copy and scale large amounts of image data that later gets discarded.
  */
 class RasterImageItem : public QGraphicsItem
 {
@@ -53,7 +81,13 @@ public:
     void setRenderingIntent(RenderingIntent::Enum intent);
 
     /**
-     * Update the internal, smaller cached versions of the main image.
+     * Forget about the current monitor profile, it will be fetched again on
+     * next repaint.
+     */
+    void resetMonitorProfile();
+
+    /**
+     * Update the internal copy of the main image and drop all rendered tiles.
      */
     void updateCache();
 
@@ -68,19 +102,23 @@ public:
     QRectF boundingRect() const override;
 
 private:
-    void applyDisplayTransform(QImage &image);
-    void updateDisplayTransform(QImage::Format format);
+    QImage sourceForZoom(qreal zoom);
+    Cms::DisplayTransform::Ptr displayTransform(QImage::Format format);
+    void resetDisplayTransform();
 
     RasterImageView *mParentView;
-    bool mApplyDisplayTransform = true;
-    cmsHTRANSFORM mDisplayTransform = nullptr;
+    Cms::DisplayTransform::Ptr mDisplayTransform;
+    QImage::Format mDisplayTransformFormat = QImage::Format_Invalid;
     cmsUInt32Number mRenderingIntent = INTENT_PERCEPTUAL;
+    int mMonitorProfileId = 0;
 
+    // The document image, or its preview while it is being decoded
     QImage mOriginalImage;
-    QImage mThirdScaledImage;
-    QImage mSixthScaledImage;
-};
+    // Size of the document, which the preview is scaled to
+    QSize mImageSize;
 
+    QCache<RasterImageTileKey, QImage> mTileCache;
+};
 }
 
 #endif // RASTERIMAGEITEM_H
@@ -84,6 +84,14 @@ struct RasterImageViewPrivate {
 
     QPointer<AbstractRasterImageViewTool> mTool;
 
+    // True if we show the preview of a document whose full image is slow to
+    // load, until the zoom requires it
+    bool mFullImageLoadingDeferred = false;
+
+    // True once completed() has been emitted for the current document: the
+    // view can be set up several times while it loads
+    bool mCompleted = false;
+
     void startAnimationIfNecessary()
     {
         if (q->document() && q->isVisible()) {
@@ -125,12 +133,14 @@ void RasterImageView::setRenderingIntent(const RenderingIntent::Enum &renderingI
 
 void RasterImageView::resetMonitorICC()
 {
-    update();
+    d->mImageItem->resetMonitorProfile();
 }
 
 void RasterImageView::loadFromDocument()
 {
     Document::Ptr doc = document();
+    d->mFullImageLoadingDeferred = false;
+    d->mCompleted = false;
     if (!doc) {
         return;
     }
@@ -140,6 +150,24 @@ void RasterImageView::loadFromDocument()
     connect(doc.data(), &Document::imageRectUpdated, this, [this]() {
         d->mImageItem->updateCache();
     });
+    connect(doc.data(), &Document::metaInfoUpdated, this, [this]() {
+        // The preview may come after the size, for example the partial
+        // images of a document loaded progressively
+        if (document()->image().isNull() && !document()->previewImage().isNull()) {
+            if (!d->mCompleted && document()->size().isValid()) {
+                // First partial image: set the zoom up before showing it
+                finishSetDocument();
+                return;
+            }
+            d->mImageItem->updateCache();
+            update();
+        }
+    });
+    connect(doc.data(), &Document::downSampledImageReady, this, [this]() {
+        // Render tiles again from the new image pyramid level
+        d->mImageItem->updateCache();
+        update();
+    });
 
     const Document::LoadingState state = doc->loadingState();
     if (state == Document::MetaInfoLoaded || state == Document::Loaded) {
@@ -151,8 +179,20 @@ void RasterImageView::slotDocumentMetaInfoLoaded()
 {
     if (document()->size().isValid() && document()->image().format() != QImage::Format_Invalid) {
         QMetaObject::invokeMethod(this, &RasterImageView::finishSetDocument, Qt::QueuedConnection);
+    } else if (document()->size().isValid() && !document()->previewImage().isNull()) {
+        // Show the embedded preview right away. Set the document up again
+        // once the image replaces it: a RAW image decoded at full resolution
+        // is larger than its preview.
+        connect(document().data(), &Document::loaded, this, &RasterImageView::finishSetDocument);
+        if (document()->isFullImageLoadingSlow()) {
+            // onZoomChanged() loads it once the preview is not enough
+            d->mFullImageLoadingDeferred = true;
+        } else {
+            document()->startLoadingFullImage();
+        }
+        QMetaObject::invokeMethod(this, &RasterImageView::finishSetDocument, Qt::QueuedConnection);
     } else {
-        // Could not retrieve image size from meta info, we need to load the
+        // Could not retrieve the image from meta info, we need to load the
         // full image now.
         connect(document().data(), &Document::loaded, this, &RasterImageView::finishSetDocument);
         document()->startLoadingFullImage();
@@ -181,7 +221,10 @@ void RasterImageView::finishSetDocument()
 
     backgroundItem()->setVisible(true);
 
-    Q_EMIT completed();
+    if (!d->mCompleted) {
+        d->mCompleted = true;
+        Q_EMIT completed();
+    }
 }
 
 void RasterImageView::slotDocumentIsAnimatedUpdated()
@@ -192,6 +235,10 @@ void RasterImageView::slotDocumentIsAnimatedUpdated()
 void RasterImageView::onZoomChanged()
 {
     d->adjustItemPosition();
+    if (d->mFullImageLoadingDeferred && zoom() >= 1) {
+        d->mFullImageLoadingDeferred = false;
+        document()->startLoadingFullImage();
+    }
 }
 
 void RasterImageView::onImageOffsetChanged()
@@ -24,6 +24,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 // Qt
 #include <QByteArray>
 #include <QFile>
+#include <QImage>
 #include <QString>
 
 // KF
@@ -33,6 +34,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
 
 // Local
 #include "gwenview_exiv2_debug.h"
+#include "gwenviewconfig.h"
+#include "imageutils.h"
+#include "orientation.h"
 
 namespace Gwenview
 {
@@ -115,4 +119,61 @@ std::unique_ptr<Exiv2::Image> Exiv2ImageLoader::popImage()
     return std::move(d->mImage);
 }
 
+QImage Exiv2ImageLoader::loadEmbeddedPreview(Exiv2::Image *image, int minSize, bool acceptSmaller, bool *transposed)
+{
+    QImage preview;
+    if (transposed) {
+        *transposed = false;
+    }
+    try {
+        Exiv2::PreviewManager manager(*image);
+        // Previews are sorted from the smallest to the largest. Try the large
+        // enough ones first, then the others from the largest.
+        const Exiv2::PreviewPropertiesList list = manager.getPreviewProperties();
+        Exiv2::PreviewPropertiesList candidates;
+        for (const Exiv2::PreviewProperties &properties : list) {
+            if (int(qMax(properties.width_, properties.height_)) >= minSize) {
+                candidates.push_back(properties);
+            }
+        }
+        if (acceptSmaller) {
+            for (auto it = list.crbegin(); it != list.crend(); ++it) {
+                if (int(qMax(it->width_, it->height_)) < minSize) {
+                    candidates.push_back(*it);
+                }
+            }
+        }
+        for (const Exiv2::PreviewProperties &properties : candidates) {
+            // Fails if the preview is stored after the part of the file we have
+            const Exiv2::PreviewImage previewImage = manager.getPreviewImage(properties);
+            if (preview.loadFromData(previewImage.pData(), previewImage.size())) {
+                break;
+            }
+        }
+        if (preview.isNull()) {
+            return preview;
+        }
+
+        const Exiv2::ExifData &exifData = image->exifData();
+        auto it = exifData.findKey(Exiv2::ExifKey("Exif.Image.Orientation"));
+        if (GwenviewConfig::applyExifOrientation() && it != exifData.end() && it->count() > 0) {
+#if EXIV2_TEST_VERSION(0, 28, 0)
+            const auto orientation = Orientation(it->toUint32());
+#else
+            const auto orientation = Orientation(it->toLong());
+#endif
+            if (orientation > NORMAL && orientation <= ROT_270) {
+                preview = preview.transformed(ImageUtils::transformMatrix(orientation));
+            }
+            if (transposed && orientation >= TRANSPOSE && orientation <= ROT_270) {
+                *transposed = true;
+            }
+        }
+    } catch (const Exiv2::Error &error) {
+        qCWarning(GWENVIEW_EXIV2_LOG) << "Could not read embedded previews. Error:" << error.what();
+        preview = QImage();
+    }
+    return preview;
+}
+
 } // namespace
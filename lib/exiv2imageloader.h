@@ -39,6 +39,7 @@ class Image;
 // Local
 
 class QByteArray;
+class QImage;
 class QString;
 
 namespace Gwenview
@@ -60,6 +61,17 @@ public:
     QString errorMessage() const;
     std::unique_ptr<Exiv2::Image> popImage();
 
+    /**
+     * Returns the smallest preview embedded in @p image which is at least
+     * @p minSize pixels large. If there is none, returns the largest one if
+     * @p acceptSmaller is true, a null image otherwise.
+     *
+     * The preview is oriented like the image if the ApplyExifOrientation
+     * option is set. @p transposed, if not null, tells whether it has been
+     * rotated by 90 or 270 degrees to do so.
+     */
+    static QImage loadEmbeddedPreview(Exiv2::Image *image, int minSize, bool acceptSmaller, bool *transposed = nullptr);
+
 private:
     Exiv2ImageLoaderPrivate *const d;
 };
@@ -0,0 +1,53 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Self
+#include "mappedfile.h"
+
+// Local
+#include "gwenview_lib_debug.h"
+
+namespace Gwenview
+{
+MappedFile::Ptr MappedFile::map(const QString &path)
+{
+    Ptr mappedFile(new MappedFile);
+    mappedFile->mFile.setFileName(path);
+    if (!mappedFile->mFile.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    mappedFile->mSize = mappedFile->mFile.size();
+    if (mappedFile->mSize <= 0) {
+        return {};
+    }
+    mappedFile->mData = mappedFile->mFile.map(0, mappedFile->mSize, QFileDevice::MapPrivateOption);
+    if (!mappedFile->mData) {
+        // process' mapping limit exceeded, file is sealed or filesystem doesn't support it, etc.
+        qCDebug(GWENVIEW_LIB_LOG) << "Could not mmap" << path << ":" << mappedFile->mFile.errorString();
+        return {};
+    }
+    return mappedFile;
+}
+
+MappedFile::~MappedFile()
+{
+    if (mData) {
+        mFile.unmap(mData);
+    }
+}
+
+QByteArray MappedFile::data() const
+{
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(mData), mSize);
+}
+
+bool MappedFile::contains(const QByteArray &array) const
+{
+    if (!mData || array.isEmpty()) {
+        return false;
+    }
+    const auto begin = reinterpret_cast<const char *>(mData);
+    return array.constData() >= begin && array.constData() + array.size() <= begin + mSize;
+}
+
+} // namespace
@@ -0,0 +1,62 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <lib/gwenviewlib_export.h>
+
+// STL
+#include <memory>
+
+// Qt
+#include <QByteArray>
+#include <QFile>
+
+namespace Gwenview
+{
+/**
+ * A read-only memory mapping of a whole file.
+ *
+ * The QByteArray returned by data() does not own its bytes: it reads directly
+ * from the page cache and is only valid as long as the MappedFile instance is
+ * alive. Share the instance through MappedFile::Ptr to keep it alive as long
+ * as the data is used.
+ */
+class GWENVIEWLIB_EXPORT MappedFile
+{
+public:
+    using Ptr = std::shared_ptr<MappedFile>;
+
+    /**
+     * Maps the file at @p path. Returns a null pointer if the file cannot be
+     * opened or mapped (empty file, filesystem without mmap support...).
+     */
+    static Ptr map(const QString &path);
+
+    ~MappedFile();
+
+    QByteArray data() const;
+
+    qint64 size() const
+    {
+        return mSize;
+    }
+
+    /**
+     * Returns true if the content of @p array lives inside the mapping
+     */
+    bool contains(const QByteArray &array) const;
+
+private:
+    MappedFile() = default;
+    Q_DISABLE_COPY(MappedFile)
+
+    QFile mFile;
+    uchar *mData = nullptr;
+    qint64 mSize = 0;
+};
+
+} // namespace
+
+#endif /* MAPPEDFILE_H */
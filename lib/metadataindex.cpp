@@ -0,0 +1,307 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "metadataindex.h"
+
+// STL
+#include <memory>
+
+// Qt
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimer>
+#include <QUrl>
+
+// KF
+#include <KFileItem>
+
+// Exiv2
+#include <exiv2/exiv2.hpp>
+
+// Local
+#include "gwenview_lib_debug.h"
+#include <lib/exiv2imageloader.h>
+#include <lib/mappedfile.h>
+
+namespace Gwenview
+{
+#undef ENABLE_LOG
+#undef LOG
+// #define ENABLE_LOG
+#ifdef ENABLE_LOG
+#define LOG(x) qCDebug(GWENVIEW_LIB_LOG) << x
+#else
+#define LOG(x) ;
+#endif
+
+static const quint32 INDEX_MAGIC = 0x47564d49; // "GVMI"
+static const quint32 INDEX_VERSION = 1;
+
+// Indexing a directory usually updates many entries in a row, wait a bit
+// before writing so that each index file is only written once
+static const int SAVE_DELAY = 2000;
+
+static QDataStream &operator<<(QDataStream &stream, const MetaDataIndex::Entry &entry)
+{
+    return stream << entry.fileMTime << entry.fileSize << entry.dateTime << qint8(entry.orientation) << entry.size;
+}
+
+static QDataStream &operator>>(QDataStream &stream, MetaDataIndex::Entry &entry)
+{
+    qint8 orientation;
+    stream >> entry.fileMTime >> entry.fileSize >> entry.dateTime >> orientation >> entry.size;
+    entry.orientation = orientation;
+    return stream;
+}
+
+static Exiv2::ExifData::const_iterator findDateTimeKey(const Exiv2::ExifData &exifData)
+{
+    // Ordered list of keys to try
+    static QList<Exiv2::ExifKey> lst = QList<Exiv2::ExifKey>() << Exiv2::ExifKey("Exif.Photo.DateTimeOriginal") << Exiv2::ExifKey("Exif.Image.DateTimeOriginal")
+                                                               << Exiv2::ExifKey("Exif.Photo.DateTimeDigitized") << Exiv2::ExifKey("Exif.Image.DateTime");
+
+    Exiv2::ExifData::const_iterator it, end = exifData.end();
+    for (const Exiv2::ExifKey &key : qAsConst(lst)) {
+        it = exifData.findKey(key);
+        if (it != end) {
+            return it;
+        }
+    }
+    return end;
+}
+
+struct DirectoryIndex {
+    QHash<QString, MetaDataIndex::Entry> mEntries;
+    bool mModified = false;
+};
+
+struct MetaDataIndexPrivate {
+    QMutex mMutex;
+    QHash<QString, DirectoryIndex> mDirectories;
+    QTimer mSaveTimer;
+
+    static QString indexPath(const QString &dirPath)
+    {
+        const QByteArray hash = QCryptographicHash::hash(dirPath.toUtf8(), QCryptographicHash::Md5).toHex();
+        return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/gwenview/metadata/") + QString::fromLatin1(hash)
+            + QStringLiteral(".index");
+    }
+
+    static DirectoryIndex load(const QString &dirPath)
+    {
+        DirectoryIndex index;
+        const MappedFile::Ptr file = MappedFile::map(indexPath(dirPath));
+        if (!file) {
+            return index;
+        }
+        QDataStream stream(file->data());
+        stream.setVersion(QDataStream::Qt_6_0);
+
+        quint32 magic;
+        quint32 version;
+        QString indexDirPath;
+        quint32 count;
+        stream >> magic >> version;
+        if (magic != INDEX_MAGIC || version != INDEX_VERSION) {
+            LOG("Ignoring index with unknown format for" << dirPath);
+            return index;
+        }
+        stream >> indexDirPath >> count;
+        if (indexDirPath != dirPath) {
+            return index;
+        }
+        index.mEntries.reserve(count);
+        for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+            QString fileName;
+            MetaDataIndex::Entry entry;
+            stream >> fileName >> entry;
+            index.mEntries.insert(fileName, entry);
+        }
+        if (stream.status() != QDataStream::Ok) {
+            qCWarning(GWENVIEW_LIB_LOG) << "Metadata index for" << dirPath << "is corrupted";
+            return DirectoryIndex();
+        }
+        LOG("Loaded" << count << "entries for" << dirPath);
+        return index;
+    }
+
+    static bool write(const QString &dirPath, const DirectoryIndex &index)
+    {
+        const QString path = indexPath(dirPath);
+        if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+            qCWarning(GWENVIEW_LIB_LOG) << "Could not create metadata index directory for" << path;
+            return false;
+        }
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            qCWarning(GWENVIEW_LIB_LOG) << "Could not write metadata index" << path << ":" << file.errorString();
+            return false;
+        }
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_6_0);
+        stream << INDEX_MAGIC << INDEX_VERSION << dirPath << quint32(index.mEntries.size());
+        for (auto it = index.mEntries.constBegin(), end = index.mEntries.constEnd(); it != end; ++it) {
+            stream << it.key() << it.value();
+        }
+        return file.commit();
+    }
+};
+
+MetaDataIndex *MetaDataIndex::instance()
+{
+    static MetaDataIndex index;
+    return &index;
+}
+
+MetaDataIndex::MetaDataIndex()
+    : d(new MetaDataIndexPrivate)
+{
+    d->mSaveTimer.setInterval(SAVE_DELAY);
+    d->mSaveTimer.setSingleShot(true);
+    connect(&d->mSaveTimer, &QTimer::timeout, this, &MetaDataIndex::save);
+    if (qApp) {
+        // We may be created from a worker thread, make sure our timer runs
+        // in the main one
+        moveToThread(qApp->thread());
+        d->mSaveTimer.moveToThread(qApp->thread());
+        connect(qApp, &QCoreApplication::aboutToQuit, this, &MetaDataIndex::save);
+    }
+}
+
+MetaDataIndex::~MetaDataIndex()
+{
+    delete d;
+}
+
+static void splitPath(const KFileItem &item, QString *dirPath, QString *fileName)
+{
+    const QString path = item.url().path();
+    const int slash = path.lastIndexOf(QLatin1Char('/'));
+    *dirPath = path.left(slash);
+    *fileName = path.mid(slash + 1);
+}
+
+bool MetaDataIndex::findEntry(const KFileItem &item, Entry *entry)
+{
+    QString dirPath;
+    QString fileName;
+    splitPath(item, &dirPath, &fileName);
+
+    QMutexLocker locker(&d->mMutex);
+    auto dirIt = d->mDirectories.find(dirPath);
+    if (dirIt == d->mDirectories.end()) {
+        dirIt = d->mDirectories.insert(dirPath, MetaDataIndexPrivate::load(dirPath));
+    }
+    auto it = dirIt->mEntries.constFind(fileName);
+    if (it == dirIt->mEntries.constEnd() || it->fileMTime != item.time(KFileItem::ModificationTime) || it->fileSize != item.size()) {
+        return false;
+    }
+    *entry = it.value();
+    return true;
+}
+
+MetaDataIndex::Entry MetaDataIndex::entryForFileItem(const KFileItem &item)
+{
+    Entry entry;
+    if (findEntry(item, &entry)) {
+        return entry;
+    }
+
+    // Do not hold the lock while parsing metadata, other threads may want
+    // entries which are already indexed
+    entry = readEntry(item);
+
+    QString dirPath;
+    QString fileName;
+    splitPath(item, &dirPath, &fileName);
+    QMutexLocker locker(&d->mMutex);
+    DirectoryIndex &index = d->mDirectories[dirPath];
+    index.mEntries.insert(fileName, entry);
+    index.mModified = true;
+    QMetaObject::invokeMethod(&d->mSaveTimer, [this]() {
+        d->mSaveTimer.start();
+    });
+    return entry;
+}
+
+MetaDataIndex::Entry MetaDataIndex::readEntry(const KFileItem &item)
+{
+    Entry entry;
+    entry.fileMTime = item.time(KFileItem::ModificationTime);
+    entry.fileSize = item.size();
+
+    const QString path = item.url().path();
+    Exiv2ImageLoader loader;
+    if (!loader.load(path)) {
+        return entry;
+    }
+    std::unique_ptr<Exiv2::Image> img(loader.popImage().release());
+    try {
+        if (img->pixelWidth() > 0 && img->pixelHeight() > 0) {
+            entry.size = QSize(img->pixelWidth(), img->pixelHeight());
+        }
+
+        const Exiv2::ExifData &exifData = img->exifData();
+        if (exifData.empty()) {
+            return entry;
+        }
+
+        auto it = exifData.findKey(Exiv2::ExifKey("Exif.Image.Orientation"));
+        if (it != exifData.end() && it->count() > 0 && it->typeId() == Exiv2::unsignedShort) {
+#if EXIV2_TEST_VERSION(0, 28, 0)
+            entry.orientation = it->toUint32();
+#else
+            entry.orientation = it->toLong();
+#endif
+        }
+
+        it = findDateTimeKey(exifData);
+        if (it == exifData.end()) {
+            qCWarning(GWENVIEW_LIB_LOG) << "No date in exif header of" << path;
+            return entry;
+        }
+
+        std::ostringstream stream;
+        stream << *it;
+        const QString value = QString::fromLocal8Bit(stream.str().c_str());
+
+        const QDateTime dt = QDateTime::fromString(value, QStringLiteral("yyyy:MM:dd hh:mm:ss"));
+        if (!dt.isValid()) {
+            qCWarning(GWENVIEW_LIB_LOG) << "Invalid date in exif header of" << path;
+            return entry;
+        }
+        entry.dateTime = dt;
+    } catch (const Exiv2::Error &error) {
+        qCWarning(GWENVIEW_LIB_LOG) << "Failed to read metadata of" << path << ". Error:" << error.what();
+    }
+    return entry;
+}
+
+void MetaDataIndex::save()
+{
+    QMutexLocker locker(&d->mMutex);
+    for (auto it = d->mDirectories.begin(), end = d->mDirectories.end(); it != end; ++it) {
+        if (it->mModified) {
+            MetaDataIndexPrivate::write(it.key(), it.value());
+            it->mModified = false;
+        }
+    }
+}
+
+void MetaDataIndex::unload()
+{
+    save();
+    QMutexLocker locker(&d->mMutex);
+    d->mDirectories.clear();
+}
+
+} // namespace
+
+#include "moc_metadataindex.cpp"
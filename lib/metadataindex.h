@@ -0,0 +1,87 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef METADATAINDEX_H
+#define METADATAINDEX_H
+
+#include <lib/gwenviewlib_export.h>
+
+// Qt
+#include <QDateTime>
+#include <QObject>
+#include <QSize>
+
+class KFileItem;
+
+namespace Gwenview
+{
+struct MetaDataIndexPrivate;
+
+/**
+ * A persistent index of the metadata Gwenview needs to sort and display
+ * images without opening them.
+ *
+ * There is one index file per directory, stored in the user cache directory.
+ * It is read with a single memory mapping the first time a file from the
+ * directory is looked up. Entries are keyed by file name and are only valid
+ * as long as the file modification time and size do not change.
+ *
+ * This class is thread-safe.
+ */
+class GWENVIEWLIB_EXPORT MetaDataIndex : public QObject
+{
+    Q_OBJECT
+public:
+    struct Entry {
+        QDateTime fileMTime;
+        qint64 fileSize = -1;
+        /// Date the picture was taken, invalid if unknown
+        QDateTime dateTime;
+        /// Exif orientation, 0 if unknown
+        int orientation = 0;
+        /// Size in pixels, invalid if unknown
+        QSize size;
+    };
+
+    static MetaDataIndex *instance();
+    ~MetaDataIndex() override;
+
+    /**
+     * Returns the entry for @p item, reading the file metadata if it is not
+     * indexed or has been modified since it was indexed.
+     *
+     * @p item must be a fast local file.
+     */
+    Entry entryForFileItem(const KFileItem &item);
+
+    /**
+     * Looks for an up to date entry for @p item without reading the file
+     * metadata. Returns false if there is none.
+     */
+    bool findEntry(const KFileItem &item, Entry *entry);
+
+    /**
+     * Reads the entry for @p item from the file metadata, bypassing the index.
+     */
+    static Entry readEntry(const KFileItem &item);
+
+public Q_SLOTS:
+    /**
+     * Writes the modified directory indexes to disk.
+     */
+    void save();
+
+    /**
+     * Saves the modified directory indexes and drops all of them from
+     * memory: the next lookups read them again from disk.
+     */
+    void unload();
+
+private:
+    MetaDataIndex();
+    MetaDataIndexPrivate *const d;
+};
+
+} // namespace
+
+#endif /* METADATAINDEX_H */
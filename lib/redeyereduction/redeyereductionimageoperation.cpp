@@ -55,7 +55,7 @@ public:
         }
         QImage img = document()->image();
         RedEyeReductionImageOperation::apply(&img, mRectF);
-        document()->editor()->setImage(img);
+        document()->editor()->updateImageRect(img, mRectF.toAlignedRect());
         setError(NoError);
     }
 
@@ -101,7 +101,7 @@ void RedEyeReductionImageOperation::undo()
         const QRect rect = d->mRectF.toAlignedRect();
         painter.drawImage(rect.topLeft(), d->mOriginalImage);
     }
-    document()->editor()->setImage(img);
+    document()->editor()->updateImageRect(img, d->mRectF.toAlignedRect());
     finish(true);
 }
 
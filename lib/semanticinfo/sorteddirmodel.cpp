@@ -20,11 +20,21 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "sorteddirmodel.h"
 
 // Qt
+#include <QFutureWatcher>
+#include <QHash>
+#include <QSet>
+#include <QThread>
+#include <QThreadPool>
 #include <QTimer>
 #include <QUrl>
+#include <QtConcurrent>
+
+// STL
+#include <memory>
 
 // KF
 #include <KDirLister>
+#include <KFileItem>
 #ifdef GWENVIEW_SEMANTICINFO_BACKEND_NONE
 #include <KDirModel>
 #endif
@@ -39,6 +49,33 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 namespace Gwenview
 {
+// Number of files whose date is read by a single task of the scanner
+static const int DATE_SCAN_BATCH_SIZE = 32;
+
+// Reading dates is mostly IO bound, do not flood the disk with requests
+static const int MAX_DATE_SCAN_THREADS = 4;
+
+// Minimum delay between two re-sorts caused by scanned dates
+static const int DATE_SCAN_RESORT_INTERVAL = 500;
+
+using DateTimeList = QList<QPair<QUrl, QDateTime>>;
+
+using ScanGeneration = std::shared_ptr<QAtomicInt>;
+
+static DateTimeList scanDateTimes(const KFileItemList &items, const ScanGeneration &currentGeneration, int generation)
+{
+    DateTimeList list;
+    list.reserve(items.size());
+    for (const KFileItem &item : items) {
+        if (currentGeneration->loadRelaxed() != generation) {
+            // The directory changed, do not waste time on files nobody wants
+            return {};
+        }
+        list << qMakePair(item.url(), TimeUtils::dateTimeForFileItem(item));
+    }
+    return list;
+}
+
 AbstractSortedDirModelFilter::AbstractSortedDirModelFilter(SortedDirModel *model)
     : QObject(model)
     , mModel(model)
@@ -65,6 +102,29 @@ struct SortedDirModelPrivate {
     QList<AbstractSortedDirModelFilter *> mFilters;
     QTimer mDelayedApplyFiltersTimer;
     MimeTypeUtils::Kinds mKindFilter;
+
+    // Date scanner
+    QHash<QUrl, QDateTime> mDateTimes;
+    KFileItemList mItemsToScan;
+    QSet<QUrl> mScheduledUrls;
+    QThreadPool mDateScanPool;
+    QTimer mStartDateScanTimer;
+    QTimer mApplyScannedDateTimesTimer;
+    // Incremented when the directory changes, so that running scans can stop
+    // early and their results can be ignored
+    ScanGeneration mDateScanGeneration = std::make_shared<QAtomicInt>(0);
+    bool mHasScannedDateTimes = false;
+
+    void resetDateTimeScan()
+    {
+        mDateScanGeneration->ref();
+        mItemsToScan.clear();
+        mScheduledUrls.clear();
+        mDateTimes.clear();
+        mStartDateScanTimer.stop();
+        mApplyScannedDateTimesTimer.stop();
+        mHasScannedDateTimes = false;
+    }
 };
 
 SortedDirModel::SortedDirModel(QObject *parent)
@@ -83,10 +143,34 @@ SortedDirModel::SortedDirModel(QObject *parent)
     d->mDelayedApplyFiltersTimer.setInterval(0);
     d->mDelayedApplyFiltersTimer.setSingleShot(true);
     connect(&d->mDelayedApplyFiltersTimer, &QTimer::timeout, this, &SortedDirModel::doApplyFilters);
+
+    d->mDateScanPool.setMaxThreadCount(qMin(QThread::idealThreadCount(), MAX_DATE_SCAN_THREADS));
+    d->mStartDateScanTimer.setInterval(0);
+    d->mStartDateScanTimer.setSingleShot(true);
+    connect(&d->mStartDateScanTimer, &QTimer::timeout, this, &SortedDirModel::startDateTimeScan);
+    d->mApplyScannedDateTimesTimer.setInterval(DATE_SCAN_RESORT_INTERVAL);
+    d->mApplyScannedDateTimesTimer.setSingleShot(true);
+    connect(&d->mApplyScannedDateTimesTimer, &QTimer::timeout, this, &SortedDirModel::applyScannedDateTimes);
+
+    connect(d->mSourceModel, &QAbstractItemModel::modelReset, this, [this]() {
+        d->resetDateTimeScan();
+    });
+    connect(d->mSourceModel, &QAbstractItemModel::dataChanged, this, [this](const QModelIndex &topLeft, const QModelIndex &bottomRight) {
+        // Files may have been modified, forget their dates
+        for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+            const KFileItem item = d->mSourceModel->itemForIndex(d->mSourceModel->index(row, 0, topLeft.parent()));
+            if (!item.isNull()) {
+                d->mDateTimes.remove(item.url());
+            }
+        }
+    });
 }
 
 SortedDirModel::~SortedDirModel()
 {
+    // Make pending scans return early
+    d->mDateScanGeneration->ref();
+    d->mDateScanPool.waitForDone();
     delete d;
 }
 
@@ -270,8 +354,8 @@ bool SortedDirModel::lessThan(const QModelIndex &left, const QModelIndex &right)
     // a secondary criterion is needed, delegate sorting to the parent class.
     if (!leftIsDirOrArchive) {
         if (sortColumn() == KDirModel::ModifiedTime) {
-            const QDateTime leftDate = TimeUtils::dateTimeForFileItem(leftItem);
-            const QDateTime rightDate = TimeUtils::dateTimeForFileItem(rightItem);
+            const QDateTime leftDate = dateTimeForSourceIndex(left);
+            const QDateTime rightDate = dateTimeForSourceIndex(right);
 
             if (leftDate != rightDate) {
                 return leftDate < rightDate;
@@ -308,6 +392,76 @@ bool SortedDirModel::hasDocuments() const
     return false;
 }
 
+QDateTime SortedDirModel::dateTimeForSourceIndex(const QModelIndex &sourceIndex) const
+{
+    const KFileItem item = itemForSourceIndex(sourceIndex);
+    if (item.isNull()) {
+        return {};
+    }
+    const QUrl url = item.url();
+    auto it = d->mDateTimes.constFind(url);
+    if (it != d->mDateTimes.constEnd()) {
+        return it.value();
+    }
+
+    // The date may already be in the metadata index
+    QDateTime dateTime = TimeUtils::dateTimeForFileItem(item, TimeUtils::CacheOnly);
+    if (dateTime.isValid()) {
+        d->mDateTimes.insert(url, dateTime);
+        return dateTime;
+    }
+
+    if (!d->mScheduledUrls.contains(url)) {
+        d->mScheduledUrls.insert(url);
+        d->mItemsToScan << item;
+        d->mStartDateScanTimer.start();
+    }
+    return item.time(KFileItem::ModificationTime);
+}
+
+void SortedDirModel::startDateTimeScan()
+{
+    for (int pos = 0; pos < d->mItemsToScan.size(); pos += DATE_SCAN_BATCH_SIZE) {
+        const KFileItemList batch = d->mItemsToScan.mid(pos, DATE_SCAN_BATCH_SIZE);
+        const int generation = d->mDateScanGeneration->loadRelaxed();
+        auto watcher = new QFutureWatcher<DateTimeList>(this);
+        watcher->setProperty("generation", generation);
+        connect(watcher, &QFutureWatcherBase::finished, this, &SortedDirModel::slotDateTimesScanned);
+        watcher->setFuture(QtConcurrent::run(&d->mDateScanPool, &scanDateTimes, batch, d->mDateScanGeneration, generation));
+    }
+    d->mItemsToScan.clear();
+}
+
+void SortedDirModel::slotDateTimesScanned()
+{
+    auto watcher = static_cast<QFutureWatcher<DateTimeList> *>(sender());
+    watcher->deleteLater();
+    if (watcher->property("generation").toInt() != d->mDateScanGeneration->loadRelaxed()) {
+        return;
+    }
+    const DateTimeList list = watcher->result();
+    for (const auto &pair : list) {
+        d->mDateTimes.insert(pair.first, pair.second);
+        d->mScheduledUrls.remove(pair.first);
+    }
+    d->mHasScannedDateTimes = true;
+    // Re-sort in batches, not for every result
+    if (!d->mApplyScannedDateTimesTimer.isActive()) {
+        d->mApplyScannedDateTimesTimer.start();
+    }
+}
+
+void SortedDirModel::applyScannedDateTimes()
+{
+    if (!d->mHasScannedDateTimes) {
+        return;
+    }
+    d->mHasScannedDateTimes = false;
+    if (sortColumn() == KDirModel::ModifiedTime || !d->mFilters.isEmpty()) {
+        invalidate();
+    }
+}
+
 void SortedDirModel::setDirLister(KDirLister *dirLister)
 {
     d->mSourceModel->setDirLister(dirLister);
@@ -34,6 +34,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 class KDirLister;
 class KFileItem;
+class QDateTime;
 class QUrl;
 
 namespace Gwenview
@@ -112,6 +113,15 @@ public:
 
     bool hasDocuments() const;
 
+    /**
+     * Returns the date of the item at @p sourceIndex, as returned by
+     * TimeUtils::dateTimeForFileItem(). This never reads the file: if the
+     * date is not known yet, it returns the modification time of the file
+     * and schedules reading the real date in the background. Sorting and
+     * filters are updated when it arrives.
+     */
+    QDateTime dateTimeForSourceIndex(const QModelIndex &sourceIndex) const;
+
 public Q_SLOTS:
     void applyFilters();
 
@@ -121,6 +131,9 @@ protected:
 
 private Q_SLOTS:
     void doApplyFilters();
+    void startDateTimeScan();
+    void slotDateTimesScanned();
+    void applyScannedDateTimes();
 
 private:
     friend struct SortedDirModelPrivate;
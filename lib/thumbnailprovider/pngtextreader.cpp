@@ -0,0 +1,150 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Self
+#include "pngtextreader.h"
+
+// Qt
+#include <QFile>
+#include <QtEndian>
+
+// Local
+#include "gwenview_lib_debug.h"
+
+namespace Gwenview
+{
+#undef ENABLE_LOG
+#undef LOG
+// #define ENABLE_LOG
+#ifdef ENABLE_LOG
+#define LOG(x) qCDebug(GWENVIEW_LIB_LOG) << x
+#else
+#define LOG(x) ;
+#endif
+
+namespace PngTextReader
+{
+static const char PNG_SIGNATURE[] = "\x89PNG\r\n\x1a\n";
+static const int PNG_SIGNATURE_SIZE = 8;
+
+// Text chunks are small, anything bigger than this is not worth reading to
+// validate a thumbnail
+static const quint32 MAX_TEXT_CHUNK_SIZE = 64 * 1024;
+
+static QByteArray inflate(const QByteArray &data)
+{
+    // qUncompress() expects the uncompressed size as a big-endian prefix. It
+    // is only a hint: the buffer grows if it is too small.
+    QByteArray buffer(4, Qt::Uninitialized);
+    qToBigEndian<quint32>(data.size() * 4, buffer.data());
+    buffer += data;
+    return qUncompress(buffer);
+}
+
+static void parseTEXt(const QByteArray &data, TextHash *texts)
+{
+    const int keyEnd = data.indexOf('\0');
+    if (keyEnd <= 0) {
+        return;
+    }
+    texts->insert(QString::fromLatin1(data.left(keyEnd)), QString::fromLatin1(data.mid(keyEnd + 1)));
+}
+
+static void parseZTXt(const QByteArray &data, TextHash *texts)
+{
+    const int keyEnd = data.indexOf('\0');
+    // Key must be followed by the compression method, 0 being the only one defined
+    if (keyEnd <= 0 || keyEnd + 1 >= data.size() || data.at(keyEnd + 1) != 0) {
+        return;
+    }
+    texts->insert(QString::fromLatin1(data.left(keyEnd)), QString::fromLatin1(inflate(data.mid(keyEnd + 2))));
+}
+
+static void parseITXt(const QByteArray &data, TextHash *texts)
+{
+    // key\0 compressionFlag compressionMethod languageTag\0 translatedKey\0 text
+    const int keyEnd = data.indexOf('\0');
+    if (keyEnd <= 0 || keyEnd + 2 >= data.size()) {
+        return;
+    }
+    const bool compressed = data.at(keyEnd + 1) != 0;
+    const int languageEnd = data.indexOf('\0', keyEnd + 3);
+    if (languageEnd < 0) {
+        return;
+    }
+    const int translatedKeyEnd = data.indexOf('\0', languageEnd + 1);
+    if (translatedKeyEnd < 0) {
+        return;
+    }
+    QByteArray text = data.mid(translatedKeyEnd + 1);
+    if (compressed) {
+        if (data.at(keyEnd + 2) != 0) {
+            return;
+        }
+        text = inflate(text);
+    }
+    texts->insert(QString::fromLatin1(data.left(keyEnd)), QString::fromUtf8(text));
+}
+
+bool read(const QString &path, TextHash *texts)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    return read(&file, texts);
+}
+
+bool read(QIODevice *device, TextHash *texts)
+{
+    Q_ASSERT(texts);
+    if (device->read(PNG_SIGNATURE_SIZE) != QByteArray::fromRawData(PNG_SIGNATURE, PNG_SIGNATURE_SIZE)) {
+        return false;
+    }
+
+    // Each chunk is: length (4 bytes), type (4 bytes), data (length bytes), CRC (4 bytes)
+    while (true) {
+        const QByteArray header = device->read(8);
+        if (header.size() != 8) {
+            LOG("Truncated file");
+            return false;
+        }
+        const quint32 length = qFromBigEndian<quint32>(header.constData());
+        const QByteArray type = header.mid(4);
+        if (type == "IDAT" || type == "IEND") {
+            // Text chunks may follow the image data, but thumbnail writers
+            // put them first: do not skip through the whole file
+            return true;
+        }
+
+        const bool isText = type == "tEXt" || type == "zTXt" || type == "iTXt";
+        if (isText && length <= MAX_TEXT_CHUNK_SIZE) {
+            const QByteArray data = device->read(length);
+            if (data.size() != int(length)) {
+                LOG("Truncated chunk" << type);
+                return false;
+            }
+            if (type == "tEXt") {
+                parseTEXt(data, texts);
+            } else if (type == "zTXt") {
+                parseZTXt(data, texts);
+            } else {
+                parseITXt(data, texts);
+            }
+            if (device->skip(4) != 4) {
+                return false;
+            }
+        } else {
+            // Skip the data and CRC without looking at them
+            const qint64 skipSize = qint64(length) + 4;
+            if (device->skip(skipSize) != skipSize) {
+                LOG("Truncated chunk" << type);
+                return false;
+            }
+        }
+    }
+}
+
+} // namespace PngTextReader
+
+} // namespace
@@ -0,0 +1,39 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef PNGTEXTREADER_H
+#define PNGTEXTREADER_H
+
+#include <lib/gwenviewlib_export.h>
+
+// Qt
+#include <QHash>
+#include <QString>
+
+class QIODevice;
+
+namespace Gwenview
+{
+/**
+ * Reads the text chunks of PNG files without decoding their pixels. Used to
+ * check whether a cached thumbnail is up to date before loading it.
+ */
+namespace PngTextReader
+{
+using TextHash = QHash<QString, QString>;
+
+/**
+ * Fills @p texts with the keys and values of the tEXt, zTXt and iTXt chunks
+ * of the PNG file at @p path which come before the image data. Reading stops
+ * at the first image data chunk.
+ * Returns false if the file cannot be read or is not a valid PNG file.
+ */
+GWENVIEWLIB_EXPORT bool read(const QString &path, TextHash *texts);
+
+GWENVIEWLIB_EXPORT bool read(QIODevice *device, TextHash *texts);
+
+} // namespace PngTextReader
+
+} // namespace
+
+#endif /* PNGTEXTREADER_H */
@@ -22,9 +22,14 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #include "thumbnailgenerator.h"
 
 // Local
+#include "exiv2imageloader.h"
 #include "gwenview_lib_debug.h"
 #include "gwenviewconfig.h"
 #include "jpegcontent.h"
+#include "pngtextreader.h"
+#include "thumbnailpackstore.h"
+#include "thumbnailprovider.h"
+#include "thumbnailwriter.h"
 
 // KDCRAW
 #ifdef KDCRAW_FOUND
@@ -33,10 +38,16 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 
 // KF
 
+// Exiv2
+#include <exiv2/exiv2.hpp>
+
 // Qt
 #include <QBuffer>
 #include <QCoreApplication>
+#include <QFile>
 #include <QImageReader>
+#include <QThread>
+#include <QThreadPool>
 
 namespace Gwenview
 {
@@ -49,15 +60,20 @@ namespace Gwenview
 #define LOG(x) ;
 #endif
 
+// Largest group generateAllGroups() produces when it is not requested
+static const ThumbnailGroup::Enum GENERATE_ALL_MAX_GROUP = ThumbnailGroup::XLarge;
+
 //------------------------------------------------------------------------
 //
 // ThumbnailContext
 //
 //------------------------------------------------------------------------
-bool ThumbnailContext::load(const QString &pixPath, int pixelSize)
+bool ThumbnailContext::load(const QString &pixPath, int pixelSize, int decodePixelSize)
 {
     mImage = QImage();
     mNeedCaching = true;
+    mFromEmbeddedThumbnail = false;
+    decodePixelSize = qMax(pixelSize, decodePixelSize);
     QImage originalImage;
     QSize originalSize;
 
@@ -128,15 +144,17 @@ bool ThumbnailContext::load(const QString &pixPath, int pixelSize)
             mImage = std::move(thumbnail);
             mOriginalWidth = content.size().width();
             mOriginalHeight = content.size().height();
+            mFromEmbeddedThumbnail = true;
             return true;
         }
     }
 
     // Generate thumbnail from full image
     originalSize = reader.size();
-    if (originalSize.isValid() && reader.supportsOption(QImageIOHandler::ScaledSize) && qMax(originalSize.width(), originalSize.height()) >= pixelSize) {
+    if (originalSize.isValid() && reader.supportsOption(QImageIOHandler::ScaledSize)
+        && qMax(originalSize.width(), originalSize.height()) >= decodePixelSize) {
         QSizeF scaledSize = originalSize;
-        scaledSize.scale(pixelSize, pixelSize, Qt::KeepAspectRatio);
+        scaledSize.scale(decodePixelSize, decodePixelSize, Qt::KeepAspectRatio);
         if (!scaledSize.isEmpty()) {
             reader.setScaledSize(scaledSize.toSize());
         }
@@ -159,11 +177,11 @@ bool ThumbnailContext::load(const QString &pixPath, int pixelSize)
     mOriginalWidth = originalSize.width() * previewRatio;
     mOriginalHeight = originalSize.height() * previewRatio;
 
-    if (qMax(mOriginalWidth, mOriginalHeight) <= pixelSize) {
+    if (qMax(mOriginalWidth, mOriginalHeight) <= decodePixelSize) {
         mImage = originalImage;
         mNeedCaching = format != "png";
     } else {
-        mImage = originalImage.scaled(pixelSize, pixelSize, Qt::KeepAspectRatio);
+        mImage = originalImage.scaled(decodePixelSize, decodePixelSize, Qt::KeepAspectRatio);
     }
 
     if (reader.autoTransform() && (reader.transformation() & QImageIOHandler::TransformationRotate90)) {
@@ -178,155 +196,262 @@ bool ThumbnailContext::load(const QString &pixPath, int pixelSize)
 // ThumbnailGenerator
 //
 //------------------------------------------------------------------------
-ThumbnailGenerator::ThumbnailGenerator()
-    : mCancel(false)
+static QSize originalSizeFromTexts(const QImage &thumbnail)
 {
-    connect(
-        qApp,
-        &QCoreApplication::aboutToQuit,
-        this,
-        [=]() {
-            cancel();
-            wait();
-        },
-        Qt::DirectConnection);
-    start();
+    bool widthOk, heightOk;
+    const int width = thumbnail.text(QStringLiteral("Thumb::Image::Width")).toInt(&widthOk);
+    const int height = thumbnail.text(QStringLiteral("Thumb::Image::Height")).toInt(&heightOk);
+    if (!widthOk || !heightOk) {
+        LOG("Thumbnail for" << thumbnail.text(QStringLiteral("Thumb::URI")) << "does not contain correct image size information");
+        return {};
+    }
+    return QSize(width, height);
 }
 
-void ThumbnailGenerator::load(const QString &originalUri,
-                              time_t originalTime,
-                              KIO::filesize_t originalFileSize,
-                              const QString &originalMimeType,
-                              const QString &pixPath,
-                              const QString &thumbnailPath,
-                              ThumbnailGroup::Enum group)
+QThreadPool *ThumbnailGenerator::threadPool()
 {
-    QMutexLocker lock(&mMutex);
-    Q_ASSERT(mPixPath.isNull());
-
-    mOriginalUri = originalUri;
-    mOriginalTime = originalTime;
-    mOriginalFileSize = originalFileSize;
-    mOriginalMimeType = originalMimeType;
-    mPixPath = pixPath;
-    mThumbnailPath = thumbnailPath;
-    mThumbnailGroup = group;
-    mCond.wakeOne();
+    static QThreadPool *pool = nullptr;
+    if (!pool) {
+        pool = new QThreadPool(qApp);
+        pool->setMaxThreadCount(QThread::idealThreadCount());
+        // Leave the CPU to the images being viewed and preloaded
+        pool->setThreadPriority(QThread::LowPriority);
+        QObject::connect(
+            qApp,
+            &QCoreApplication::aboutToQuit,
+            pool,
+            [=]() {
+                pool->clear();
+                pool->waitForDone();
+            },
+            Qt::DirectConnection);
+    }
+    return pool;
 }
 
-QString ThumbnailGenerator::originalUri() const
+int ThumbnailGenerator::maxRunningRequests()
 {
-    return mOriginalUri;
+    return threadPool()->maxThreadCount();
 }
 
-bool ThumbnailGenerator::isStopped()
+static void cacheThumbnail(const ThumbnailRequest &request, ThumbnailGroup::Enum group, const QString &thumbnailPath, QImage &image, const QSize &originalSize)
 {
-    QMutexLocker lock(&mMutex);
-    return mStopped;
+    image.setText(QStringLiteral("Thumb::URI"), request.originalUri);
+    image.setText(QStringLiteral("Thumb::MTime"), QString::number(request.originalTime));
+    image.setText(QStringLiteral("Thumb::Size"), QString::number(request.originalFileSize));
+    image.setText(QStringLiteral("Thumb::Mimetype"), request.originalMimeType);
+    image.setText(QStringLiteral("Thumb::Image::Width"), QString::number(originalSize.width()));
+    image.setText(QStringLiteral("Thumb::Image::Height"), QString::number(originalSize.height()));
+    image.setText(QStringLiteral("Software"), QStringLiteral("Gwenview"));
+    if (ThumbnailPackStore::isEnabled()) {
+        ThumbnailPackStore::instance()->insert(request.originalUri, group, image);
+    }
+    // Blocks if the writer is lagging behind, which keeps us from
+    // generating more thumbnails than it can handle
+    ThumbnailWriter::instance()->queueThumbnail(thumbnailPath, image);
 }
 
-time_t ThumbnailGenerator::originalTime() const
+ThumbnailResult ThumbnailGenerator::generate(const ThumbnailRequest &request)
 {
-    return mOriginalTime;
+    return generateGroups(request, {});
 }
 
-KIO::filesize_t ThumbnailGenerator::originalFileSize() const
+ThumbnailResult ThumbnailGenerator::generateGroups(const ThumbnailRequest &request, const QList<ThumbnailGroup::Enum> &otherGroups)
 {
-    return mOriginalFileSize;
-}
+    LOG("Loading" << request.pixPath);
+    ThumbnailResult result;
+    ThumbnailContext context;
+    if (request.group > ThumbnailGroup::XXLarge) {
+        if (context.load(request.pixPath, ThumbnailGroup::pixelSize(request.group))) {
+            result.image = context.mImage;
+            result.originalSize = QSize(context.mOriginalWidth, context.mOriginalHeight);
+        }
+        return result;
+    }
 
-QString ThumbnailGenerator::originalMimeType() const
-{
-    return mOriginalMimeType;
+    ThumbnailGroup::Enum largestGroup = request.group;
+    for (ThumbnailGroup::Enum group : otherGroups) {
+        largestGroup = qMax(largestGroup, group);
+    }
+    if (!context.load(request.pixPath, ThumbnailGroup::pixelSize(request.group), ThumbnailGroup::pixelSize(largestGroup))) {
+        qCWarning(GWENVIEW_LIB_LOG) << "Could not generate thumbnail for file" << request.originalUri;
+        return result;
+    }
+    result.originalSize = QSize(context.mOriginalWidth, context.mOriginalHeight);
+
+    QList<ThumbnailGroup::Enum> groups = otherGroups;
+    if (context.mFromEmbeddedThumbnail) {
+        // It is only large enough for the requested group and the smaller ones
+        groups.removeIf([&request](ThumbnailGroup::Enum group) {
+            return group > request.group;
+        });
+    }
+    if (!groups.contains(request.group)) {
+        groups << request.group;
+    }
+    for (ThumbnailGroup::Enum group : qAsConst(groups)) {
+        const int pixelSize = ThumbnailGroup::pixelSize(group);
+        QImage image = context.mImage;
+        bool needCaching = context.mNeedCaching;
+        if (qMax(image.width(), image.height()) > pixelSize) {
+            image = image.scaled(pixelSize, pixelSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            needCaching = true;
+        }
+        const bool isRequestedGroup = group == request.group;
+        if (needCaching) {
+            const QString path = isRequestedGroup ? request.thumbnailPath : ThumbnailProvider::thumbnailPath(request.originalUri, group);
+            cacheThumbnail(request, group, path, image, result.originalSize);
+        }
+        if (isRequestedGroup) {
+            result.image = image;
+        }
+    }
+    LOG("Done, size=" << result.originalSize);
+    return result;
 }
 
-bool ThumbnailGenerator::testCancel()
+ThumbnailResult ThumbnailGenerator::generateFromHeader(const ThumbnailRequest &request)
 {
-    QMutexLocker lock(&mMutex);
-    return mCancel;
+    LOG("Looking for an embedded thumbnail in" << request.originalUri);
+    ThumbnailResult result;
+    QFile file(request.pixPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return result;
+    }
+    // Exiv2 does not copy the data, it must outlive the image
+    const QByteArray data = file.readAll();
+    Exiv2ImageLoader loader;
+    if (!loader.load(data)) {
+        LOG("Could not parse header of" << request.originalUri << ":" << loader.errorMessage());
+        return result;
+    }
+    std::unique_ptr<Exiv2::Image> image = loader.popImage();
+
+    const int pixelSize = ThumbnailGroup::pixelSize(request.group);
+    // Same rule as ThumbnailContext::load()
+    const bool acceptSmall = GwenviewConfig::lowResourceUsageMode();
+    if (image->mimeType() == "image/jpeg") {
+        JpegContent content;
+        if (!content.loadFromData(data, image.get())) {
+            return result;
+        }
+        const QImage thumbnail = content.thumbnail();
+        if (!thumbnail.isNull() && (acceptSmall || qMax(thumbnail.width(), thumbnail.height()) >= pixelSize)) {
+            result.image = thumbnail;
+            result.originalSize = content.size();
+        }
+    } else {
+        bool transposed;
+        result.image = Exiv2ImageLoader::loadEmbeddedPreview(image.get(), pixelSize, acceptSmall, &transposed);
+        result.originalSize = QSize(image->pixelWidth(), image->pixelHeight());
+        if (transposed) {
+            result.originalSize.transpose();
+        }
+    }
+    if (result.image.isNull()) {
+        return result;
+    }
+
+    if (qMax(result.image.width(), result.image.height()) > pixelSize) {
+        result.image = result.image.scaled(pixelSize, pixelSize, Qt::KeepAspectRatio);
+    }
+    if (request.group <= ThumbnailGroup::XXLarge) {
+        cacheThumbnail(request, request.group, request.thumbnailPath, result.image, result.originalSize);
+    }
+    return result;
 }
 
-void ThumbnailGenerator::cancel()
+static bool isCachedThumbnailUpToDate(const ThumbnailRequest &request, const QString &path)
 {
-    QMutexLocker lock(&mMutex);
-    mCancel = true;
-    mCond.wakeOne();
+    PngTextReader::TextHash texts;
+    return PngTextReader::read(path, &texts) && texts.value(QStringLiteral("Thumb::MTime")).toLongLong() == qint64(request.originalTime);
 }
 
-void ThumbnailGenerator::run()
+static QImage loadLargerCachedThumbnail(const ThumbnailRequest &request)
 {
-    while (!testCancel()) {
-        QString pixPath;
-        int pixelSize;
-        {
-            QMutexLocker lock(&mMutex);
-            // empty mPixPath means nothing to do
-            if (mPixPath.isNull()) {
-                mCond.wait(&mMutex);
-            }
-        }
-        if (testCancel()) {
-            break;
+    for (int group = request.group + 1; group <= ThumbnailGroup::XXLarge; ++group) {
+        const QString path = ThumbnailProvider::thumbnailPath(request.originalUri, ThumbnailGroup::Enum(group));
+        QImage image = ThumbnailWriter::instance()->value(path);
+        if (image.isNull() && isCachedThumbnailUpToDate(request, path)) {
+            image.load(path, "png");
         }
-        {
-            QMutexLocker lock(&mMutex);
-            pixPath = mPixPath;
-            pixelSize = ThumbnailGroup::pixelSize(mThumbnailGroup);
+        if (!image.isNull() && image.text(QStringLiteral("Thumb::MTime")).toLongLong() == qint64(request.originalTime)) {
+            return image;
         }
+    }
+    return {};
+}
 
-        Q_ASSERT(!pixPath.isNull());
-        LOG("Loading" << pixPath);
-        ThumbnailContext context;
-        bool ok = context.load(pixPath, pixelSize);
-
-        {
-            QMutexLocker lock(&mMutex);
-            if (ok) {
-                mImage = context.mImage;
-                mOriginalWidth = context.mOriginalWidth;
-                mOriginalHeight = context.mOriginalHeight;
-                if (context.mNeedCaching && mThumbnailGroup <= ThumbnailGroup::XXLarge) {
-                    cacheThumbnail();
-                }
-            } else {
-                // avoid emitting the thumb from the previous successful run
-                mImage = QImage();
-                qCWarning(GWENVIEW_LIB_LOG) << "Could not generate thumbnail for file" << mOriginalUri;
-            }
-            mPixPath.clear(); // done, ready for next
+ThumbnailResult ThumbnailGenerator::generateAllGroups(const ThumbnailRequest &request)
+{
+    if (request.group > ThumbnailGroup::XXLarge) {
+        return generate(request);
+    }
+
+    const QImage largerImage = loadLargerCachedThumbnail(request);
+    if (!largerImage.isNull()) {
+        LOG("Scaling down a larger thumbnail of" << request.originalUri);
+        ThumbnailResult result;
+        const int pixelSize = ThumbnailGroup::pixelSize(request.group);
+        result.image = largerImage.scaled(pixelSize, pixelSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        const QStringList textKeys = largerImage.textKeys();
+        for (const QString &key : textKeys) {
+            result.image.setText(key, largerImage.text(key));
         }
-        if (testCancel()) {
-            break;
+        result.originalSize = originalSizeFromTexts(largerImage);
+        if (ThumbnailPackStore::isEnabled()) {
+            ThumbnailPackStore::instance()->insert(request.originalUri, request.group, result.image);
         }
-        {
-            QSize size(mOriginalWidth, mOriginalHeight);
-            LOG("emitting done signal, size=" << size);
-            QMutexLocker lock(&mMutex);
-            Q_EMIT done(mImage, size);
-            LOG("Done");
+        ThumbnailWriter::instance()->queueThumbnail(request.thumbnailPath, result.image);
+        return result;
+    }
+
+    // Produce the other groups from the same decode, so that changing the
+    // thumbnail size does not read the original again. XXLarge thumbnails
+    // are four times larger than XLarge ones and seldom used, only produce
+    // them on request. The embedded thumbnail still serves small groups.
+    QList<ThumbnailGroup::Enum> otherGroups;
+    for (int group = ThumbnailGroup::Normal; group <= qMax(request.group, GENERATE_ALL_MAX_GROUP); ++group) {
+        if (group != request.group
+            && !isCachedThumbnailUpToDate(request, ThumbnailProvider::thumbnailPath(request.originalUri, ThumbnailGroup::Enum(group)))) {
+            otherGroups << ThumbnailGroup::Enum(group);
         }
     }
+    return generateGroups(request, otherGroups);
+}
 
-    LOG("Ending thread");
+ThumbnailResult ThumbnailGenerator::loadFromCache(const ThumbnailRequest &request)
+{
+    LOG("Loading" << request.thumbnailPath);
+    ThumbnailResult result;
+    // Callers have validated the thumbnail before asking us to load it, but
+    // it may have been replaced since then
+    if (!result.image.load(request.thumbnailPath, "png")
+        || result.image.text(QStringLiteral("Thumb::MTime")).toLongLong() != qint64(request.originalTime)) {
+        qCWarning(GWENVIEW_LIB_LOG) << "Could not load cached thumbnail" << request.thumbnailPath;
+        result.image = QImage();
+        return request.pixPath.isEmpty() ? result : generate(request);
+    }
 
-    QMutexLocker lock(&mMutex);
-    mStopped = true;
-    deleteLater();
+    result.originalSize = originalSizeFromTexts(result.image);
+    if (ThumbnailPackStore::isEnabled()) {
+        // Keep the pack in sync with the freedesktop.org cache
+        ThumbnailPackStore::instance()->insert(request.originalUri, request.group, result.image);
+    }
+    return result;
 }
 
-void ThumbnailGenerator::cacheThumbnail()
+ThumbnailResult ThumbnailGenerator::loadFromPack(const ThumbnailRequest &request)
 {
-    mImage.setText(QStringLiteral("Thumb::URI"), mOriginalUri);
-    mImage.setText(QStringLiteral("Thumb::MTime"), QString::number(mOriginalTime));
-    mImage.setText(QStringLiteral("Thumb::Size"), QString::number(mOriginalFileSize));
-    mImage.setText(QStringLiteral("Thumb::Mimetype"), mOriginalMimeType);
-    mImage.setText(QStringLiteral("Thumb::Image::Width"), QString::number(mOriginalWidth));
-    mImage.setText(QStringLiteral("Thumb::Image::Height"), QString::number(mOriginalHeight));
-    mImage.setText(QStringLiteral("Software"), QStringLiteral("Gwenview"));
-
-    Q_EMIT thumbnailReadyToBeCached(mThumbnailPath, mImage);
+    LOG("Loading" << request.originalUri << "from pack");
+    ThumbnailResult result;
+    result.image = ThumbnailPackStore::instance()->thumbnail(request.originalUri, request.group);
+    if (result.image.isNull()) {
+        return loadFromCache(request);
+    }
+    result.originalSize = originalSizeFromTexts(result.image);
+    return result;
 }
 
 } // namespace
 
-#include "moc_thumbnailgenerator.cpp"
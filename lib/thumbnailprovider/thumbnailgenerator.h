@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #define THUMBNAILGENERATOR_H
 
 // Local
+#include <lib/gwenviewlib_export.h>
 #include <lib/thumbnailgroup.h>
 
 // KF
@@ -29,9 +30,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 
 // Qt
 #include <QImage>
-#include <QMutex>
-#include <QThread>
-#include <QWaitCondition>
+#include <QList>
+
+class QThreadPool;
 
 namespace Gwenview
 {
@@ -40,61 +41,102 @@ struct ThumbnailContext {
     int mOriginalWidth;
     int mOriginalHeight;
     bool mNeedCaching;
+    // True if mImage is the thumbnail embedded in the original
+    bool mFromEmbeddedThumbnail;
+
+    /**
+     * Uses the thumbnail embedded in @p pixPath if it is at least
+     * @p pixelSize large, otherwise decodes the original at
+     * @p decodePixelSize, which defaults to @p pixelSize.
+     */
+    bool load(const QString &pixPath, int pixelSize, int decodePixelSize = 0);
+};
 
-    bool load(const QString &pixPath, int pixelSize);
+/**
+ * A thumbnail to generate from a local file
+ */
+struct ThumbnailRequest {
+    QString originalUri;
+    time_t originalTime = 0;
+    KIO::filesize_t originalFileSize = 0;
+    QString originalMimeType;
+    QString pixPath;
+    QString thumbnailPath;
+    ThumbnailGroup::Enum group = ThumbnailGroup::Normal;
 };
 
-class ThumbnailGenerator : public QThread
-{
-    Q_OBJECT
-public:
-    ThumbnailGenerator();
-
-    // Because we override run(), like you're not really supposed to do, we
-    // can't trust isRunning()
-    bool isStopped();
-
-    void load(const QString &originalUri,
-              time_t originalTime,
-              KIO::filesize_t originalFileSize,
-              const QString &originalMimeType,
-              const QString &pixPath,
-              const QString &thumbnailPath,
-              ThumbnailGroup::Enum group);
-
-    void cancel();
-
-    QString originalUri() const;
-    time_t originalTime() const;
-    KIO::filesize_t originalFileSize() const;
-    QString originalMimeType() const;
-
-protected:
-    void run() override;
-
-Q_SIGNALS:
-    void done(const QImage &, const QSize &);
-    void thumbnailReadyToBeCached(const QString &thumbnailPath, const QImage &);
-
-private:
-    bool testCancel();
-    void cacheThumbnail();
-    QImage mImage;
-    QString mPixPath;
-    QString mThumbnailPath;
-    QString mOriginalUri;
-    time_t mOriginalTime;
-    KIO::filesize_t mOriginalFileSize;
-    QString mOriginalMimeType;
-    int mOriginalWidth;
-    int mOriginalHeight;
-    QMutex mMutex;
-    QWaitCondition mCond;
-    ThumbnailGroup::Enum mThumbnailGroup;
-    bool mCancel;
-    bool mStopped = false;
+struct ThumbnailResult {
+    // Null if the thumbnail could not be generated
+    QImage image;
+    QSize originalSize;
 };
 
+/**
+ * Generates thumbnails on a pool of low priority worker threads, sized to the
+ * number of CPU cores. It is separate from the DecodeScheduler pool because
+ * generation tasks block when thumbnails are produced faster than they can
+ * be written, and must not keep documents from being decoded meanwhile.
+ * Requests are started in the order they are submitted, so submitting them
+ * in visibility order makes results come back in roughly that order.
+ */
+namespace ThumbnailGenerator
+{
+QThreadPool *threadPool();
+
+/**
+ * Maximum number of requests a client should have in flight at the same
+ * time. Submitting more only delays cancellation of pending work.
+ */
+int maxRunningRequests();
+
+/**
+ * Generates the thumbnail described by @p request and queues it to the
+ * ThumbnailWriter if it should be cached. Can be called from any thread.
+ */
+ThumbnailResult generate(const ThumbnailRequest &request);
+
+/**
+ * Like generate(), but also produces the thumbnails for @p otherGroups from
+ * the same decode of the original, done at the size of the largest group.
+ * They are stored at ThumbnailProvider::thumbnailPath(). If the thumbnail
+ * embedded in the original is used for request.group, the larger groups are
+ * not produced. Returns the thumbnail for request.group. Can be called from
+ * any thread.
+ */
+GWENVIEWLIB_EXPORT ThumbnailResult generateGroups(const ThumbnailRequest &request, const QList<ThumbnailGroup::Enum> &otherGroups);
+
+/**
+ * Produces the thumbnail for request.group without reading the original
+ * again if an up-to-date thumbnail of a larger group is cached. Otherwise
+ * generates it along with the thumbnails of the other groups up to XLarge
+ * which are not cached yet, from a single decode of the original. Can be
+ * called from any thread.
+ */
+ThumbnailResult generateAllGroups(const ThumbnailRequest &request);
+
+/**
+ * Generates the thumbnail from the thumbnail or preview embedded in
+ * request.pixPath, which only contains the beginning of the original file.
+ * Returns a null image if there is none large enough for request.group. Can
+ * be called from any thread.
+ */
+ThumbnailResult generateFromHeader(const ThumbnailRequest &request);
+
+/**
+ * Loads the up-to-date thumbnail stored at request.thumbnailPath. Falls back
+ * to generate() if it cannot be decoded and request.pixPath is set. Can be
+ * called from any thread.
+ */
+ThumbnailResult loadFromCache(const ThumbnailRequest &request);
+
+/**
+ * Loads the up-to-date thumbnail from the ThumbnailPackStore, falls back to
+ * loadFromCache() if it cannot be decoded. Can be called from any thread.
+ */
+ThumbnailResult loadFromPack(const ThumbnailRequest &request);
+
+} // namespace ThumbnailGenerator
+
 } // namespace
 
 #endif /* THUMBNAILGENERATOR_H */
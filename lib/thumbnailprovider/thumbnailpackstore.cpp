@@ -0,0 +1,557 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Self
+#include "thumbnailpackstore.h"
+
+// Qt
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QLockFile>
+#include <QMutex>
+#include <QSaveFile>
+#include <QSet>
+#include <QTimer>
+
+// Local
+#include "gwenview_lib_debug.h"
+#include "gwenviewconfig.h"
+#include "thumbnailprovider.h"
+#include <lib/mappedfile.h>
+
+namespace Gwenview
+{
+#undef ENABLE_LOG
+#undef LOG
+// #define ENABLE_LOG
+#ifdef ENABLE_LOG
+#define LOG(x) qCDebug(GWENVIEW_LIB_LOG) << x
+#else
+#define LOG(x) ;
+#endif
+
+static const quint32 PACK_MAGIC = 0x47565450; // "GVTP"
+static const quint32 PACK_VERSION = 1;
+
+// Same as MetaDataIndex: generating thumbnails updates many entries in a row
+static const int SAVE_DELAY = 2000;
+
+// Thumbnails are small, the fastest zlib level already brings most of the
+// size reduction and keeps inflating cheaper than decoding a PNG
+static const int COMPRESSION_LEVEL = 1;
+
+// gwenview_thumbnailer and Gwenview may write the same packs, but never for
+// long: adding a thumbnail or saving an index takes milliseconds
+static const int LOCK_TIMEOUT = 5000;
+
+static const ThumbnailGroup::Enum s_thumbnailGroups[] = {
+    ThumbnailGroup::Normal,
+    ThumbnailGroup::Large,
+    ThumbnailGroup::XLarge,
+    ThumbnailGroup::XXLarge,
+};
+
+struct PackEntry {
+    qint64 mOriginalTime = 0;
+    quint64 mOriginalFileSize = 0;
+    QString mMimeType;
+    QSize mOriginalSize;
+    QSize mImageSize;
+    qint32 mBytesPerLine = 0;
+    qint32 mFormat = QImage::Format_Invalid;
+    // Position of the compressed pixels in the data file
+    qint64 mOffset = 0;
+    qint32 mLength = 0;
+};
+
+static QDataStream &operator<<(QDataStream &stream, const PackEntry &entry)
+{
+    return stream << entry.mOriginalTime << entry.mOriginalFileSize << entry.mMimeType << entry.mOriginalSize << entry.mImageSize << entry.mBytesPerLine
+                  << entry.mFormat << entry.mOffset << entry.mLength;
+}
+
+static QDataStream &operator>>(QDataStream &stream, PackEntry &entry)
+{
+    return stream >> entry.mOriginalTime >> entry.mOriginalFileSize >> entry.mMimeType >> entry.mOriginalSize >> entry.mImageSize >> entry.mBytesPerLine
+        >> entry.mFormat >> entry.mOffset >> entry.mLength;
+}
+
+struct ThumbnailPack {
+    QString mDirUri;
+    // Incremented each time the data file is compacted, so that the index
+    // never refers to a data file it has not been written for
+    quint32 mGeneration = 0;
+    // Keyed by file name
+    QHash<QString, PackEntry> mEntries;
+    // Bytes of the data file no longer referenced by any entry
+    qint64 mGarbageSize = 0;
+    MappedFile::Ptr mMappedData;
+    // Last modification time and size of the index file we read or wrote,
+    // to find out if another process wrote it since
+    QDateTime mIndexTime;
+    qint64 mIndexSize = 0;
+    // Changes not written to the index yet, applied again if we have to
+    // reload it
+    QHash<QString, PackEntry> mPendingEntries;
+    QSet<QString> mPendingRemovals;
+
+    bool isModified() const
+    {
+        return !mPendingEntries.isEmpty() || !mPendingRemovals.isEmpty();
+    }
+
+    qint64 liveSize() const
+    {
+        qint64 size = 0;
+        for (const PackEntry &entry : mEntries) {
+            size += entry.mLength;
+        }
+        return size;
+    }
+};
+
+static void splitUri(const QString &uri, QString *dirUri, QString *fileName)
+{
+    const int slash = uri.lastIndexOf(QLatin1Char('/'));
+    *dirUri = uri.left(slash);
+    *fileName = uri.mid(slash + 1);
+}
+
+static void deleteByteArray(void *info)
+{
+    delete static_cast<QByteArray *>(info);
+}
+
+struct ThumbnailPackStorePrivate {
+    QMutex mMutex;
+    // Keyed by base path, see basePath()
+    QHash<QString, ThumbnailPack> mPacks;
+    QTimer mSaveTimer;
+
+    static QString packDir()
+    {
+        return ThumbnailProvider::thumbnailBaseDir() + QStringLiteral("x-gwenview-packs/");
+    }
+
+    static QString basePath(const QString &dirUri, ThumbnailGroup::Enum group)
+    {
+        const QByteArray hash = QCryptographicHash::hash(dirUri.toUtf8(), QCryptographicHash::Md5).toHex();
+        return packDir() + QString::fromLatin1(hash) + QLatin1Char('-') + QString::number(ThumbnailGroup::pixelSize(group));
+    }
+
+    static QString indexPath(const QString &basePath)
+    {
+        return basePath + QStringLiteral(".index");
+    }
+
+    static QString dataPath(const QString &basePath, quint32 generation)
+    {
+        return basePath + QLatin1Char('.') + QString::number(generation) + QStringLiteral(".data");
+    }
+
+    static QString lockPath(const QString &basePath)
+    {
+        return basePath + QStringLiteral(".lock");
+    }
+
+    static void readIndexInfo(const QString &basePath, ThumbnailPack &pack)
+    {
+        const QFileInfo info(indexPath(basePath));
+        pack.mIndexTime = info.lastModified();
+        pack.mIndexSize = info.size();
+    }
+
+    static void updateGarbageSize(const QString &basePath, ThumbnailPack &pack)
+    {
+        pack.mGarbageSize = qMax(qint64(0), QFileInfo(dataPath(basePath, pack.mGeneration)).size() - pack.liveSize());
+    }
+
+    ThumbnailPack &pack(const QString &basePath, const QString &dirUri)
+    {
+        auto it = mPacks.find(basePath);
+        if (it == mPacks.end()) {
+            it = mPacks.insert(basePath, load(basePath, dirUri));
+        }
+        return it.value();
+    }
+
+    static ThumbnailPack load(const QString &basePath, const QString &dirUri)
+    {
+        ThumbnailPack pack;
+        pack.mDirUri = dirUri;
+        readIndexInfo(basePath, pack);
+        const MappedFile::Ptr file = MappedFile::map(indexPath(basePath));
+        if (!file) {
+            return pack;
+        }
+        QDataStream stream(file->data());
+        stream.setVersion(QDataStream::Qt_6_0);
+
+        quint32 magic;
+        quint32 version;
+        QString packDirUri;
+        quint32 generation;
+        quint32 count;
+        stream >> magic >> version;
+        if (magic != PACK_MAGIC || version != PACK_VERSION) {
+            LOG("Ignoring pack with unknown format for" << dirUri);
+            return pack;
+        }
+        stream >> packDirUri >> generation >> count;
+        if (packDirUri != dirUri) {
+            return pack;
+        }
+        pack.mEntries.reserve(count);
+        for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+            QString fileName;
+            PackEntry entry;
+            stream >> fileName >> entry;
+            pack.mEntries.insert(fileName, entry);
+        }
+        if (stream.status() != QDataStream::Ok) {
+            qCWarning(GWENVIEW_LIB_LOG) << "Thumbnail pack for" << dirUri << "is corrupted";
+            ThumbnailPack emptyPack;
+            emptyPack.mDirUri = dirUri;
+            emptyPack.mIndexTime = pack.mIndexTime;
+            emptyPack.mIndexSize = pack.mIndexSize;
+            return emptyPack;
+        }
+        pack.mGeneration = generation;
+        updateGarbageSize(basePath, pack);
+        LOG("Loaded" << count << "entries for" << dirUri);
+        return pack;
+    }
+
+    /**
+     * Reloads the index of @p pack if another process wrote it since we read
+     * or wrote it, and applies our pending changes on top of it. Must be
+     * called with the pack locked.
+     */
+    static void refresh(const QString &basePath, ThumbnailPack &pack)
+    {
+        const QFileInfo info(indexPath(basePath));
+        if (info.lastModified() == pack.mIndexTime && info.size() == pack.mIndexSize) {
+            return;
+        }
+        LOG("Reloading pack modified by another process for" << pack.mDirUri);
+        ThumbnailPack diskPack = load(basePath, pack.mDirUri);
+        if (diskPack.mGeneration == pack.mGeneration) {
+            diskPack.mMappedData = pack.mMappedData;
+            for (auto it = pack.mPendingEntries.constBegin(), end = pack.mPendingEntries.constEnd(); it != end; ++it) {
+                diskPack.mEntries.insert(it.key(), it.value());
+            }
+            diskPack.mPendingEntries = pack.mPendingEntries;
+        } else if (!pack.mPendingEntries.isEmpty()) {
+            // The data file we appended them to has been compacted away. They
+            // are still in the freedesktop.org cache, they will be added again
+            // next time they are loaded from it.
+            LOG("Dropping" << pack.mPendingEntries.size() << "thumbnails of a compacted pack for" << pack.mDirUri);
+        }
+        for (const QString &fileName : qAsConst(pack.mPendingRemovals)) {
+            diskPack.mEntries.remove(fileName);
+        }
+        diskPack.mPendingRemovals = pack.mPendingRemovals;
+        updateGarbageSize(basePath, diskPack);
+        pack = diskPack;
+    }
+
+    static bool writeIndex(const QString &basePath, const ThumbnailPack &pack)
+    {
+        const QString path = indexPath(basePath);
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly)) {
+            qCWarning(GWENVIEW_LIB_LOG) << "Could not write thumbnail pack index" << path << ":" << file.errorString();
+            return false;
+        }
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_6_0);
+        stream << PACK_MAGIC << PACK_VERSION << pack.mDirUri << pack.mGeneration << quint32(pack.mEntries.size());
+        for (auto it = pack.mEntries.constBegin(), end = pack.mEntries.constEnd(); it != end; ++it) {
+            stream << it.key() << it.value();
+        }
+        return file.commit();
+    }
+
+    /**
+     * Writes the live entries of @p pack to a new data file
+     */
+    static bool compact(const QString &basePath, ThumbnailPack &pack)
+    {
+        LOG("Compacting" << pack.mDirUri);
+        const MappedFile::Ptr oldData = MappedFile::map(dataPath(basePath, pack.mGeneration));
+        if (!oldData) {
+            return false;
+        }
+        const quint32 generation = pack.mGeneration + 1;
+        QSaveFile file(dataPath(basePath, generation));
+        if (!file.open(QIODevice::WriteOnly)) {
+            qCWarning(GWENVIEW_LIB_LOG) << "Could not compact thumbnail pack" << file.fileName() << ":" << file.errorString();
+            return false;
+        }
+        QHash<QString, PackEntry> entries = pack.mEntries;
+        qint64 offset = 0;
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (it->mOffset + it->mLength > oldData->size()) {
+                it = entries.erase(it);
+                continue;
+            }
+            file.write(oldData->data().constData() + it->mOffset, it->mLength);
+            it->mOffset = offset;
+            offset += it->mLength;
+            ++it;
+        }
+        if (!file.commit()) {
+            return false;
+        }
+        pack.mEntries = entries;
+        pack.mGeneration = generation;
+        pack.mGarbageSize = 0;
+        pack.mMappedData.reset();
+        return true;
+    }
+
+    void scheduleSave()
+    {
+        QMetaObject::invokeMethod(&mSaveTimer, [this]() {
+            mSaveTimer.start();
+        });
+    }
+};
+
+ThumbnailPackStore *ThumbnailPackStore::instance()
+{
+    static ThumbnailPackStore store;
+    return &store;
+}
+
+ThumbnailPackStore::ThumbnailPackStore()
+    : d(new ThumbnailPackStorePrivate)
+{
+    d->mSaveTimer.setInterval(SAVE_DELAY);
+    d->mSaveTimer.setSingleShot(true);
+    connect(&d->mSaveTimer, &QTimer::timeout, this, &ThumbnailPackStore::save);
+    if (qApp) {
+        // We are usually created from a worker thread, make sure our timer
+        // runs in the main one
+        moveToThread(qApp->thread());
+        d->mSaveTimer.moveToThread(qApp->thread());
+        connect(qApp, &QCoreApplication::aboutToQuit, this, &ThumbnailPackStore::save);
+    }
+}
+
+ThumbnailPackStore::~ThumbnailPackStore()
+{
+    delete d;
+}
+
+bool ThumbnailPackStore::isEnabled()
+{
+    return GwenviewConfig::thumbnailPacks() && !GwenviewConfig::lowResourceUsageMode();
+}
+
+bool ThumbnailPackStore::contains(const QString &uri, ThumbnailGroup::Enum group, time_t mtime, KIO::filesize_t fileSize)
+{
+    QString dirUri;
+    QString fileName;
+    splitUri(uri, &dirUri, &fileName);
+
+    QMutexLocker locker(&d->mMutex);
+    const ThumbnailPack &pack = d->pack(ThumbnailPackStorePrivate::basePath(dirUri, group), dirUri);
+    auto it = pack.mEntries.constFind(fileName);
+    // Like in the freedesktop.org cache, a null size means it was unknown
+    return it != pack.mEntries.constEnd() && it->mOriginalTime == mtime && (it->mOriginalFileSize == 0 || it->mOriginalFileSize == fileSize);
+}
+
+QImage ThumbnailPackStore::thumbnail(const QString &uri, ThumbnailGroup::Enum group)
+{
+    QString dirUri;
+    QString fileName;
+    splitUri(uri, &dirUri, &fileName);
+
+    PackEntry entry;
+    MappedFile::Ptr data;
+    {
+        QMutexLocker locker(&d->mMutex);
+        const QString basePath = ThumbnailPackStorePrivate::basePath(dirUri, group);
+        ThumbnailPack &pack = d->pack(basePath, dirUri);
+        auto it = pack.mEntries.constFind(fileName);
+        if (it == pack.mEntries.constEnd()) {
+            return {};
+        }
+        entry = it.value();
+        // The data file grows as thumbnails are added, map it again if the
+        // current mapping is too short
+        if (!pack.mMappedData || pack.mMappedData->size() < entry.mOffset + entry.mLength) {
+            pack.mMappedData = MappedFile::map(ThumbnailPackStorePrivate::dataPath(basePath, pack.mGeneration));
+        }
+        data = pack.mMappedData;
+    }
+    if (!data || data->size() < entry.mOffset + entry.mLength) {
+        qCWarning(GWENVIEW_LIB_LOG) << "Thumbnail pack data for" << dirUri << "is truncated";
+        return {};
+    }
+
+    // Inflate outside of the lock, the mapping stays valid as long as we
+    // hold a reference to it
+    const QByteArray compressed = QByteArray::fromRawData(data->data().constData() + entry.mOffset, entry.mLength);
+    auto pixels = new QByteArray(qUncompress(compressed));
+    const auto format = QImage::Format(entry.mFormat);
+    if (format <= QImage::Format_Invalid || format >= QImage::NImageFormats || entry.mImageSize.isEmpty()
+        || pixels->size() < qint64(entry.mBytesPerLine) * entry.mImageSize.height()) {
+        qCWarning(GWENVIEW_LIB_LOG) << "Invalid thumbnail in pack for" << uri;
+        delete pixels;
+        return {};
+    }
+
+    // The image takes ownership of the inflated buffer, no need to copy it
+    QImage image(reinterpret_cast<uchar *>(pixels->data()),
+                 entry.mImageSize.width(),
+                 entry.mImageSize.height(),
+                 entry.mBytesPerLine,
+                 format,
+                 deleteByteArray,
+                 pixels);
+    image.setText(QStringLiteral("Thumb::URI"), uri);
+    image.setText(QStringLiteral("Thumb::MTime"), QString::number(entry.mOriginalTime));
+    image.setText(QStringLiteral("Thumb::Size"), QString::number(entry.mOriginalFileSize));
+    image.setText(QStringLiteral("Thumb::Mimetype"), entry.mMimeType);
+    if (entry.mOriginalSize.isValid()) {
+        image.setText(QStringLiteral("Thumb::Image::Width"), QString::number(entry.mOriginalSize.width()));
+        image.setText(QStringLiteral("Thumb::Image::Height"), QString::number(entry.mOriginalSize.height()));
+    }
+    image.setText(QStringLiteral("Software"), QStringLiteral("Gwenview"));
+    return image;
+}
+
+void ThumbnailPackStore::insert(const QString &uri, ThumbnailGroup::Enum group, const QImage &thumbnail)
+{
+    QString dirUri;
+    QString fileName;
+    splitUri(uri, &dirUri, &fileName);
+
+    // Store pixels as-is, except for indexed formats which would need their
+    // color table
+    QImage image = thumbnail;
+    if (!image.colorTable().isEmpty()) {
+        image = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    }
+
+    PackEntry entry;
+    entry.mOriginalTime = thumbnail.text(QStringLiteral("Thumb::MTime")).toLongLong();
+    entry.mOriginalFileSize = thumbnail.text(QStringLiteral("Thumb::Size")).toULongLong();
+    entry.mMimeType = thumbnail.text(QStringLiteral("Thumb::Mimetype"));
+    bool widthOk, heightOk;
+    const int width = thumbnail.text(QStringLiteral("Thumb::Image::Width")).toInt(&widthOk);
+    const int height = thumbnail.text(QStringLiteral("Thumb::Image::Height")).toInt(&heightOk);
+    if (widthOk && heightOk) {
+        entry.mOriginalSize = QSize(width, height);
+    }
+    entry.mImageSize = image.size();
+    entry.mBytesPerLine = image.bytesPerLine();
+    entry.mFormat = image.format();
+    const QByteArray compressed = qCompress(image.constBits(), image.sizeInBytes(), COMPRESSION_LEVEL);
+    entry.mLength = compressed.size();
+
+    QMutexLocker locker(&d->mMutex);
+    const QString basePath = ThumbnailPackStorePrivate::basePath(dirUri, group);
+    ThumbnailPack &pack = d->pack(basePath, dirUri);
+    if (!QDir().mkpath(ThumbnailPackStorePrivate::packDir())) {
+        qCWarning(GWENVIEW_LIB_LOG) << "Could not create thumbnail pack directory";
+        return;
+    }
+    // Another process may have compacted the pack, make sure we append to
+    // its current data file
+    QLockFile lockFile(ThumbnailPackStorePrivate::lockPath(basePath));
+    if (!lockFile.tryLock(LOCK_TIMEOUT)) {
+        qCWarning(GWENVIEW_LIB_LOG) << "Could not lock thumbnail pack for" << dirUri;
+        return;
+    }
+    ThumbnailPackStorePrivate::refresh(basePath, pack);
+    // Data is only ever appended: a reader may have mapped the file, and the
+    // index on disk stays valid if we do not get to save it
+    QFile file(ThumbnailPackStorePrivate::dataPath(basePath, pack.mGeneration));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCWarning(GWENVIEW_LIB_LOG) << "Could not open thumbnail pack" << file.fileName() << ":" << file.errorString();
+        return;
+    }
+    entry.mOffset = file.size();
+    if (file.write(compressed) != compressed.size()) {
+        qCWarning(GWENVIEW_LIB_LOG) << "Could not write to thumbnail pack" << file.fileName() << ":" << file.errorString();
+        return;
+    }
+
+    auto it = pack.mEntries.find(fileName);
+    if (it != pack.mEntries.end()) {
+        pack.mGarbageSize += it->mLength;
+        *it = entry;
+    } else {
+        pack.mEntries.insert(fileName, entry);
+    }
+    pack.mPendingEntries.insert(fileName, entry);
+    pack.mPendingRemovals.remove(fileName);
+    d->scheduleSave();
+}
+
+void ThumbnailPackStore::remove(const QString &uri)
+{
+    QString dirUri;
+    QString fileName;
+    splitUri(uri, &dirUri, &fileName);
+
+    QMutexLocker locker(&d->mMutex);
+    for (auto group : s_thumbnailGroups) {
+        ThumbnailPack &pack = d->pack(ThumbnailPackStorePrivate::basePath(dirUri, group), dirUri);
+        auto it = pack.mEntries.find(fileName);
+        if (it == pack.mEntries.end()) {
+            continue;
+        }
+        pack.mGarbageSize += it->mLength;
+        pack.mEntries.erase(it);
+        pack.mPendingEntries.remove(fileName);
+        pack.mPendingRemovals.insert(fileName);
+        d->scheduleSave();
+    }
+}
+
+void ThumbnailPackStore::save()
+{
+    QMutexLocker locker(&d->mMutex);
+    for (auto it = d->mPacks.begin(), end = d->mPacks.end(); it != end; ++it) {
+        ThumbnailPack &pack = it.value();
+        if (!pack.isModified()) {
+            continue;
+        }
+        // Hold the lock from reading the index to removing the old data file,
+        // so that no other process appends to it or overwrites our changes
+        QLockFile lockFile(ThumbnailPackStorePrivate::lockPath(it.key()));
+        if (!lockFile.tryLock(LOCK_TIMEOUT)) {
+            qCWarning(GWENVIEW_LIB_LOG) << "Could not lock thumbnail pack for" << pack.mDirUri;
+            continue;
+        }
+        ThumbnailPackStorePrivate::refresh(it.key(), pack);
+        if (!pack.isModified()) {
+            continue;
+        }
+        // Once most of the data file is made of replaced or removed
+        // thumbnails, rewrite it. The old one is only removed once the new
+        // index has been written.
+        const quint32 oldGeneration = pack.mGeneration;
+        const bool compacted = pack.mGarbageSize > pack.liveSize() && ThumbnailPackStorePrivate::compact(it.key(), pack);
+        if (ThumbnailPackStorePrivate::writeIndex(it.key(), pack)) {
+            pack.mPendingEntries.clear();
+            pack.mPendingRemovals.clear();
+            ThumbnailPackStorePrivate::readIndexInfo(it.key(), pack);
+            if (compacted) {
+                QFile::remove(ThumbnailPackStorePrivate::dataPath(it.key(), oldGeneration));
+            }
+        }
+    }
+}
+
+} // namespace
+
+#include "moc_thumbnailpackstore.cpp"
@@ -0,0 +1,85 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef THUMBNAILPACKSTORE_H
+#define THUMBNAILPACKSTORE_H
+
+#include <lib/gwenviewlib_export.h>
+
+// Qt
+#include <QImage>
+#include <QObject>
+
+// KF
+#include <KIO/Global>
+
+// Local
+#include <lib/thumbnailgroup.h>
+
+namespace Gwenview
+{
+struct ThumbnailPackStorePrivate;
+
+/**
+ * Stores the thumbnails of a whole directory in a single pack, in addition to
+ * the freedesktop.org thumbnail cache.
+ *
+ * A pack is made of an index file, read in one go the first time a thumbnail
+ * of the directory is looked up, and a data file holding the lightly
+ * compressed pixels of all the thumbnails, which is memory-mapped. Packs live
+ * in the "x-gwenview-packs" folder of ThumbnailProvider::thumbnailBaseDir().
+ *
+ * The freedesktop.org cache remains the reference: thumbnails are added to
+ * the packs when they are written to it or loaded from it.
+ *
+ * This class is thread-safe.
+ */
+class GWENVIEWLIB_EXPORT ThumbnailPackStore : public QObject
+{
+    Q_OBJECT
+public:
+    static ThumbnailPackStore *instance();
+    ~ThumbnailPackStore() override;
+
+    /**
+     * Returns true if packs are enabled in the configuration
+     */
+    static bool isEnabled();
+
+    /**
+     * Returns true if the pack has a thumbnail for @p uri which is up to date
+     * with the original @p mtime and @p fileSize. Does not decode anything.
+     */
+    bool contains(const QString &uri, ThumbnailGroup::Enum group, time_t mtime, KIO::filesize_t fileSize);
+
+    /**
+     * Returns the thumbnail for @p uri, with the same Thumb:: text keys as
+     * the freedesktop.org cache, or a null image if there is none.
+     */
+    QImage thumbnail(const QString &uri, ThumbnailGroup::Enum group);
+
+    /**
+     * Adds @p thumbnail to the pack, replacing any previous version. The
+     * Thumb:: text keys of @p thumbnail must be set.
+     */
+    void insert(const QString &uri, ThumbnailGroup::Enum group, const QImage &thumbnail);
+
+    /**
+     * Removes the thumbnails of @p uri from the packs of all groups
+     */
+    void remove(const QString &uri);
+
+public Q_SLOTS:
+    /**
+     * Writes the modified pack indexes to disk
+     */
+    void save();
+
+private:
+    ThumbnailPackStore();
+    ThumbnailPackStorePrivate *const d;
+};
+
+} // namespace
+
+#endif /* THUMBNAILPACKSTORE_H */
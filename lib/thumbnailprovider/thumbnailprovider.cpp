@@ -27,24 +27,33 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+// STL
+#include <algorithm>
+
 // Qt
 #include <QApplication>
 #include <QCryptographicHash>
 #include <QDir>
 #include <QFile>
+#include <QFutureWatcher>
 #include <QStandardPaths>
 #include <QTemporaryFile>
+#include <QtConcurrentRun>
 
 // KF
 #include <KIO/FileCopyJob>
+#include <KIO/FileJob>
 #include <KIO/PreviewJob>
 #include <KIO/StatJob>
 #include <KJobWidgets>
 
 // Local
 #include "gwenview_lib_debug.h"
+#include "gwenviewconfig.h"
 #include "mimetypeutils.h"
+#include "pngtextreader.h"
 #include "thumbnailgenerator.h"
+#include "thumbnailpackstore.h"
 #include "thumbnailwriter.h"
 #include "urlutils.h"
 
@@ -59,7 +68,23 @@ namespace Gwenview
 #define LOG(x) ;
 #endif
 
-Q_GLOBAL_STATIC(ThumbnailWriter, sThumbnailWriter)
+struct ThumbnailGenerationTask {
+    ThumbnailRequest mRequest;
+    // Null if the item has been removed or the provider stopped while the
+    // thumbnail was being generated. In this case the thumbnail is cached but
+    // not emitted.
+    KFileItem mItem;
+    // The temporary path for remote urls
+    QString mTempPath;
+    // Set if mTempPath only contains the beginning of the original
+    bool mFromHeader = false;
+    QFutureWatcher<ThumbnailResult> mWatcher;
+};
+
+// How much of remote originals is read to look for an embedded thumbnail
+// or preview before falling back to downloading them. Covers the EXIF
+// segment of JPEG files and the first previews of most raw formats.
+static const int REMOTE_HEADER_SIZE = 2 * 1024 * 1024;
 
 static const ThumbnailGroup::Enum s_thumbnailGroups[] = {
     ThumbnailGroup::Normal,
@@ -128,12 +153,25 @@ QString ThumbnailProvider::thumbnailBaseDir(ThumbnailGroup::Enum group)
     return dir;
 }
 
+QString ThumbnailProvider::originalUri(const QUrl &url)
+{
+    return generateOriginalUri(url);
+}
+
+QString ThumbnailProvider::thumbnailPath(const QString &originalUri, ThumbnailGroup::Enum group)
+{
+    return generateThumbnailPath(originalUri, group);
+}
+
 void ThumbnailProvider::deleteImageThumbnail(const QUrl &url)
 {
     QString uri = generateOriginalUri(url);
     for (auto group : s_thumbnailGroups) {
         QFile::remove(generateThumbnailPath(uri, group));
     }
+    if (ThumbnailPackStore::isEnabled()) {
+        ThumbnailPackStore::instance()->remove(uri);
+    }
 }
 
 static void moveThumbnailHelper(const QString &oldUri, const QString &newUri, ThumbnailGroup::Enum group)
@@ -156,6 +194,10 @@ void ThumbnailProvider::moveThumbnail(const QUrl &oldUrl, const QUrl &newUrl)
     for (auto group : s_thumbnailGroups) {
         moveThumbnailHelper(oldUri, newUri, group);
     }
+    // The moved thumbnails are added back to the packs when they get loaded
+    if (ThumbnailPackStore::isEnabled()) {
+        ThumbnailPackStore::instance()->remove(oldUri);
+    }
 }
 
 //------------------------------------------------------------------------
@@ -180,38 +222,35 @@ ThumbnailProvider::ThumbnailProvider()
     // Look for images and store the items in our todo list
     mCurrentItem = KFileItem();
     mThumbnailGroup = ThumbnailGroup::XXLarge;
-    createNewThumbnailGenerator();
 }
 
 ThumbnailProvider::~ThumbnailProvider()
 {
     LOG(this);
-    disconnect(mThumbnailGenerator, nullptr, this, nullptr);
-    disconnect(mThumbnailGenerator, nullptr, sThumbnailWriter, nullptr);
     abortSubjob();
-    mThumbnailGenerator->cancel();
-    if (mPreviousThumbnailGenerator) {
-        disconnect(mPreviousThumbnailGenerator, nullptr, sThumbnailWriter, nullptr);
+    // Tasks still running on the thread pool finish on their own, their
+    // results are dropped
+    for (ThumbnailGenerationTask *task : qAsConst(mGenerationTasks)) {
+        if (!task->mTempPath.isEmpty()) {
+            QFile::remove(task->mTempPath);
+        }
+        delete task;
     }
-    sThumbnailWriter->requestInterruption();
-    sThumbnailWriter->wait();
+    ThumbnailWriter::instance()->requestInterruption();
+    ThumbnailWriter::instance()->wait();
 }
 
 void ThumbnailProvider::stop()
 {
-    // Clear mItems and create a new ThumbnailGenerator if mThumbnailGenerator is running,
-    // but also make sure that at most two ThumbnailGenerators are running.
-    // startCreatingThumbnail() will take care that these two threads won't work on the same item.
+    // Clear mItems and detach running generation tasks from their items: they
+    // still cache their thumbnails, and startCreatingThumbnail() reuses them
+    // if one of their items comes back.
     mItems.clear();
     abortSubjob();
-    if (!mThumbnailGenerator->isStopped() && !mPreviousThumbnailGenerator) {
-        mPreviousThumbnailGenerator = mThumbnailGenerator;
-        mPreviousThumbnailGenerator->cancel();
-        disconnect(mPreviousThumbnailGenerator, nullptr, this, nullptr);
-        connect(mPreviousThumbnailGenerator, SIGNAL(finished()), mPreviousThumbnailGenerator, SLOT(deleteLater()));
-        createNewThumbnailGenerator();
-        mCurrentItem = KFileItem();
+    for (ThumbnailGenerationTask *task : qAsConst(mGenerationTasks)) {
+        task->mItem = KFileItem();
     }
+    mCurrentItem = KFileItem();
 }
 
 const KFileItemList &ThumbnailProvider::pendingItems() const
@@ -245,7 +284,7 @@ void ThumbnailProvider::appendItems(const KFileItemList &items)
 
 void ThumbnailProvider::removeItems(const KFileItemList &itemList)
 {
-    if (mItems.isEmpty()) {
+    if (mItems.isEmpty() && mGenerationTasks.isEmpty()) {
         return;
     }
     for (const KFileItem &item : itemList) {
@@ -256,6 +295,12 @@ void ThumbnailProvider::removeItems(const KFileItemList &itemList)
         if (item == mCurrentItem) {
             abortSubjob();
         }
+
+        for (ThumbnailGenerationTask *task : qAsConst(mGenerationTasks)) {
+            if (task->mItem == item) {
+                task->mItem = KFileItem();
+            }
+        }
     }
 
     // No more current item, carry on to the next remaining item
@@ -271,21 +316,10 @@ void ThumbnailProvider::removePendingItems()
 
 bool ThumbnailProvider::isRunning() const
 {
-    return !mCurrentItem.isNull();
+    return !mCurrentItem.isNull() || !mGenerationTasks.isEmpty();
 }
 
 //-Internal--------------------------------------------------------------
-void ThumbnailProvider::createNewThumbnailGenerator()
-{
-    mThumbnailGenerator = new ThumbnailGenerator;
-    connect(mThumbnailGenerator, SIGNAL(done(QImage, QSize)), SLOT(thumbnailReady(QImage, QSize)), Qt::QueuedConnection);
-
-    connect(mThumbnailGenerator,
-            SIGNAL(thumbnailReadyToBeCached(QString, QImage)),
-            sThumbnailWriter,
-            SLOT(queueThumbnail(QString, QImage)),
-            Qt::QueuedConnection);
-}
 
 void ThumbnailProvider::abortSubjob()
 {
@@ -307,7 +341,17 @@ void ThumbnailProvider::determineNextIcon()
     if (mItems.isEmpty()) {
         LOG("No more items. Nothing to do");
         mCurrentItem = KFileItem();
-        Q_EMIT finished();
+        if (mGenerationTasks.isEmpty()) {
+            Q_EMIT finished();
+        }
+        return;
+    }
+
+    // Wait for a generation task to finish, generationTaskFinished() will
+    // call us again
+    if (mGenerationTasks.count() >= ThumbnailGenerator::maxRunningRequests()) {
+        LOG("All generation slots are busy");
+        mCurrentItem = KFileItem();
         return;
     }
 
@@ -360,6 +404,30 @@ void ThumbnailProvider::slotResult(KJob *job)
         return;
     }
 
+    case STATE_READHEADER: {
+        if (job->error() || mHeaderData.isEmpty()) {
+            // The worker may not support random access
+            LOG("Could not read header:" << job->errorString());
+            mHeaderData.clear();
+            startDownloadingOriginal();
+            return;
+        }
+        QFile file(mTempPath);
+        const bool ok = file.open(QIODevice::WriteOnly) && file.write(mHeaderData) == mHeaderData.size();
+        file.close();
+        mHeaderData.clear();
+        if (!ok) {
+            qCWarning(GWENVIEW_LIB_LOG) << "Could not write header of" << mCurrentUrl.toDisplayString() << "to" << mTempPath;
+            startDownloadingOriginal();
+        } else if (mHeaderComplete) {
+            // The file turned out to be small enough to be read completely
+            startCreatingThumbnail(mTempPath);
+        } else {
+            startGenerationTask(mTempPath, &ThumbnailGenerator::generateFromHeader);
+        }
+        return;
+    }
+
     case STATE_DOWNLOADORIG:
         if (job->error()) {
             emitThumbnailLoadingFailed();
@@ -378,21 +446,35 @@ void ThumbnailProvider::slotResult(KJob *job)
     }
 }
 
-void ThumbnailProvider::thumbnailReady(const QImage &_img, const QSize &_size)
+void ThumbnailProvider::generationTaskFinished(ThumbnailGenerationTask *task)
 {
-    QImage img = _img;
-    QSize size = _size;
-    if (!img.isNull()) {
-        emitThumbnailLoaded(img, size);
-    } else {
-        emitThumbnailLoadingFailed();
+    mGenerationTasks.removeOne(task);
+    const ThumbnailResult result = task->mWatcher.result();
+
+    if (!task->mItem.isNull() && result.image.isNull() && task->mFromHeader) {
+        // No usable embedded thumbnail, try again with the whole file
+        LOG("Download whole file for" << task->mItem.url());
+        mFullDownloadUrls.insert(task->mItem.url().adjusted(QUrl::NormalizePathSegments));
+        mItems.prepend(task->mItem);
+    } else if (!task->mItem.isNull()) {
+        LOG(task->mItem.url());
+        if (!result.image.isNull()) {
+            Q_EMIT thumbnailLoaded(task->mItem, QPixmap::fromImage(result.image), result.originalSize, task->mRequest.originalFileSize);
+        } else {
+            Q_EMIT thumbnailLoadingFailed(task->mItem);
+        }
+    }
+
+    if (!task->mTempPath.isEmpty()) {
+        LOG("Delete temp file" << task->mTempPath);
+        QFile::remove(task->mTempPath);
     }
-    if (!mTempPath.isEmpty()) {
-        LOG("Delete temp file" << mTempPath);
-        QFile::remove(mTempPath);
-        mTempPath.clear();
+    delete task;
+
+    // Carry on if determineNextIcon() was waiting for a free slot
+    if (mCurrentItem.isNull()) {
+        determineNextIcon();
     }
-    determineNextIcon();
 }
 
 QImage ThumbnailProvider::loadThumbnailFromCache() const
@@ -401,7 +483,7 @@ QImage ThumbnailProvider::loadThumbnailFromCache() const
         return {};
     }
 
-    QImage image = sThumbnailWriter->value(mThumbnailPath);
+    QImage image = ThumbnailWriter::instance()->value(mThumbnailPath);
     if (!image.isNull()) {
         return image;
     }
@@ -424,7 +506,7 @@ QImage ThumbnailProvider::loadThumbnailFromCache() const
                 QString text = largeImage.text(key);
                 image.setText(key, text);
             }
-            sThumbnailWriter->queueThumbnail(mThumbnailPath, image);
+            ThumbnailWriter::instance()->queueThumbnail(mThumbnailPath, image);
             break;
         }
     }
@@ -453,11 +535,34 @@ void ThumbnailProvider::checkThumbnail()
 
     LOG("Stat thumb" << mThumbnailPath);
 
+    if (mThumbnailGroup <= ThumbnailGroup::XXLarge && ThumbnailPackStore::isEnabled()
+        && ThumbnailPackStore::instance()->contains(mOriginalUri, mThumbnailGroup, mOriginalTime, mOriginalFileSize)) {
+        startLoadingCachedThumbnail(&ThumbnailGenerator::loadFromPack);
+        return;
+    }
+
+    // Validate the cached thumbnail from its text chunks: stale thumbnails
+    // are not decoded at all and up-to-date ones are decoded on the thread
+    // pool.
+    PngTextReader::TextHash texts;
+    if (mThumbnailGroup <= ThumbnailGroup::XXLarge && ThumbnailWriter::instance()->value(mThumbnailPath).isNull()
+        && PngTextReader::read(mThumbnailPath, &texts)) {
+        if (isThumbnailUpToDate(texts.value(QStringLiteral("Thumb::URI")),
+                                texts.value(QStringLiteral("Thumb::MTime")),
+                                texts.value(QStringLiteral("Thumb::Size")))) {
+            startLoadingCachedThumbnail(&ThumbnailGenerator::loadFromCache);
+        } else {
+            LOG("Cached thumbnail is out of date");
+            createThumbnail();
+        }
+        return;
+    }
+
     QImage thumb = loadThumbnailFromCache();
-    KIO::filesize_t fileSize = thumb.text(QStringLiteral("Thumb::Size")).toULongLong();
     if (!thumb.isNull()) {
-        if (thumb.text(QStringLiteral("Thumb::URI")) == mOriginalUri && thumb.text(QStringLiteral("Thumb::MTime")).toInt() == mOriginalTime
-            && (fileSize == 0 || fileSize == mOriginalFileSize)) {
+        if (isThumbnailUpToDate(thumb.text(QStringLiteral("Thumb::URI")),
+                                thumb.text(QStringLiteral("Thumb::MTime")),
+                                thumb.text(QStringLiteral("Thumb::Size")))) {
             int width = 0, height = 0;
             QSize size;
             bool ok;
@@ -483,15 +588,24 @@ void ThumbnailProvider::checkThumbnail()
         }
     }
 
+    createThumbnail();
+}
+
+bool ThumbnailProvider::isThumbnailUpToDate(const QString &uri, const QString &mtime, const QString &size) const
+{
+    const KIO::filesize_t fileSize = size.toULongLong();
+    return uri == mOriginalUri && mtime.toInt() == mOriginalTime && (fileSize == 0 || fileSize == mOriginalFileSize);
+}
+
+void ThumbnailProvider::createThumbnail()
+{
     // Thumbnail not found or not valid
     if (MimeTypeUtils::fileItemKind(mCurrentItem) == MimeTypeUtils::KIND_RASTER_IMAGE) {
         if (mCurrentUrl.isLocalFile()) {
             // Original is a local file, create the thumbnail
             startCreatingThumbnail(mCurrentUrl.toLocalFile());
         } else {
-            // Original is remote, download it
-            mState = STATE_DOWNLOADORIG;
-
+            // Original is remote
             QTemporaryFile tempFile;
             tempFile.setAutoRemove(false);
             if (!tempFile.open()) {
@@ -502,11 +616,14 @@ void ThumbnailProvider::checkThumbnail()
             }
             mTempPath = tempFile.fileName();
 
-            QUrl url = QUrl::fromLocalFile(mTempPath);
-            KIO::Job *job = KIO::file_copy(mCurrentUrl, url, -1, KIO::Overwrite | KIO::HideProgressInfo);
-            KJobWidgets::setWindow(job, qApp->activeWindow());
-            LOG("Download remote file" << mCurrentUrl.toDisplayString() << "to" << url.toDisplayString());
-            addSubjob(job);
+            // Embedded thumbnails and previews are usually stored at the
+            // beginning of the file, try to avoid downloading all of it
+            const bool fullDownload = mFullDownloadUrls.remove(mCurrentUrl);
+            if (fullDownload || (mOriginalFileSize > 0 && mOriginalFileSize <= KIO::filesize_t(REMOTE_HEADER_SIZE))) {
+                startDownloadingOriginal();
+            } else {
+                startReadingHeader();
+            }
         }
     } else {
         // Not a raster image, use a KPreviewJob
@@ -526,22 +643,111 @@ void ThumbnailProvider::checkThumbnail()
     }
 }
 
+void ThumbnailProvider::startReadingHeader()
+{
+    LOG("Read header of remote file" << mCurrentUrl.toDisplayString());
+    mState = STATE_READHEADER;
+    mHeaderData.clear();
+    mHeaderComplete = false;
+
+    KIO::FileJob *job = KIO::open(mCurrentUrl, QIODevice::ReadOnly);
+    KJobWidgets::setWindow(job, qApp->activeWindow());
+    connect(job, &KIO::FileJob::open, this, [job]() {
+        job->read(REMOTE_HEADER_SIZE);
+    });
+    connect(job, &KIO::FileJob::data, this, [this, job](KIO::Job *, const QByteArray &data) {
+        // Workers may send less than asked for, keep reading until we have
+        // enough or reach the end of the file
+        mHeaderData += data;
+        if (data.isEmpty()) {
+            mHeaderComplete = true;
+            job->close();
+        } else if (mHeaderData.size() >= REMOTE_HEADER_SIZE) {
+            job->close();
+        } else {
+            job->read(REMOTE_HEADER_SIZE - mHeaderData.size());
+        }
+    });
+    addSubjob(job);
+}
+
+void ThumbnailProvider::startDownloadingOriginal()
+{
+    mState = STATE_DOWNLOADORIG;
+    QUrl url = QUrl::fromLocalFile(mTempPath);
+    KIO::Job *job = KIO::file_copy(mCurrentUrl, url, -1, KIO::Overwrite | KIO::HideProgressInfo);
+    KJobWidgets::setWindow(job, qApp->activeWindow());
+    LOG("Download remote file" << mCurrentUrl.toDisplayString() << "to" << url.toDisplayString());
+    addSubjob(job);
+}
+
 void ThumbnailProvider::startCreatingThumbnail(const QString &pixPath)
 {
     LOG("Creating thumbnail from" << pixPath);
-    // If mPreviousThumbnailGenerator is already working on our current item
-    // its thumbnail will be passed to sThumbnailWriter when ready. So we
-    // connect mPreviousThumbnailGenerator's signal "finished" to determineNextIcon
-    // which will load the thumbnail from sThumbnailWriter or from disk
-    // (because we re-add mCurrentItem to mItems).
-    if (mPreviousThumbnailGenerator && !mPreviousThumbnailGenerator->isStopped() && mOriginalUri == mPreviousThumbnailGenerator->originalUri()
-        && mOriginalTime == mPreviousThumbnailGenerator->originalTime() && mOriginalFileSize == mPreviousThumbnailGenerator->originalFileSize()
-        && mCurrentItem.mimetype() == mPreviousThumbnailGenerator->originalMimeType()) {
-        connect(mPreviousThumbnailGenerator, SIGNAL(finished()), SLOT(determineNextIcon()));
-        mItems.prepend(mCurrentItem);
+    // Producing all the sizes costs a bit more than producing one, but then
+    // changing the thumbnail size never reads the original again. Thumbnails
+    // are not stored in low resource mode, so there is no point there.
+    if (GwenviewConfig::generateAllThumbnailSizes() && !GwenviewConfig::lowResourceUsageMode()) {
+        startGenerationTask(pixPath, &ThumbnailGenerator::generateAllGroups);
+    } else {
+        startGenerationTask(pixPath, &ThumbnailGenerator::generate);
+    }
+}
+
+void ThumbnailProvider::startLoadingCachedThumbnail(ThumbnailResult (*function)(const ThumbnailRequest &))
+{
+    LOG("Loading cached thumbnail" << mThumbnailPath);
+    // If the cached thumbnail turns out to be corrupted, local files can be
+    // thumbnailed again right away
+    const QString pixPath = mCurrentUrl.isLocalFile() && MimeTypeUtils::fileItemKind(mCurrentItem) == MimeTypeUtils::KIND_RASTER_IMAGE
+        ? mCurrentUrl.toLocalFile()
+        : QString();
+    startGenerationTask(pixPath, function);
+}
+
+void ThumbnailProvider::startGenerationTask(const QString &pixPath, ThumbnailResult (*function)(const ThumbnailRequest &))
+{
+    ThumbnailRequest request;
+    request.originalUri = mOriginalUri;
+    request.originalTime = mOriginalTime;
+    request.originalFileSize = mOriginalFileSize;
+    request.originalMimeType = mCurrentItem.mimetype();
+    request.pixPath = pixPath;
+    request.thumbnailPath = mThumbnailPath;
+    request.group = mThumbnailGroup;
+
+    // If a task detached by stop() or removeItems() is already working on our
+    // current item, give the item back to it instead of generating the
+    // thumbnail a second time.
+    auto it = std::find_if(mGenerationTasks.constBegin(), mGenerationTasks.constEnd(), [&request](const ThumbnailGenerationTask *task) {
+        const ThumbnailRequest &other = task->mRequest;
+        return other.thumbnailPath == request.thumbnailPath && other.originalTime == request.originalTime
+            && other.originalFileSize == request.originalFileSize && other.originalMimeType == request.originalMimeType;
+    });
+    if (it != mGenerationTasks.constEnd()) {
+        LOG("Reusing running task for" << mCurrentItem.url());
+        (*it)->mItem = mCurrentItem;
+        if (!mTempPath.isEmpty()) {
+            QFile::remove(mTempPath);
+            mTempPath.clear();
+        }
+        determineNextIcon();
         return;
     }
-    mThumbnailGenerator->load(mOriginalUri, mOriginalTime, mOriginalFileSize, mCurrentItem.mimetype(), pixPath, mThumbnailPath, mThumbnailGroup);
+
+    auto task = new ThumbnailGenerationTask;
+    task->mRequest = request;
+    task->mItem = mCurrentItem;
+    task->mTempPath = mTempPath;
+    task->mFromHeader = function == &ThumbnailGenerator::generateFromHeader;
+    mTempPath.clear();
+    connect(&task->mWatcher, &QFutureWatcherBase::finished, this, [this, task]() {
+        generationTaskFinished(task);
+    });
+    task->mWatcher.setFuture(QtConcurrent::run(ThumbnailGenerator::threadPool(), function, request));
+    mGenerationTasks.append(task);
+
+    determineNextIcon();
 }
 
 void ThumbnailProvider::slotGotPreview(const KFileItem &item, const QPixmap &pixmap)
@@ -578,7 +784,12 @@ void ThumbnailProvider::emitThumbnailLoadingFailed()
 
 bool ThumbnailProvider::isThumbnailWriterEmpty()
 {
-    return sThumbnailWriter->isEmpty();
+    return ThumbnailWriter::instance()->isEmpty();
+}
+
+void ThumbnailProvider::flushThumbnailWriter()
+{
+    ThumbnailWriter::instance()->flush();
 }
 
 } // namespace
@@ -28,8 +28,9 @@
 
 // Qt
 #include <QImage>
+#include <QList>
 #include <QPixmap>
-#include <QPointer>
+#include <QSet>
 
 // KF
 #include <KFileItem>
@@ -40,11 +41,17 @@
 
 namespace Gwenview
 {
-class ThumbnailGenerator;
 class ThumbnailWriter;
+struct ThumbnailGenerationTask;
+struct ThumbnailRequest;
+struct ThumbnailResult;
 
 /**
  * A job that determines the thumbnails for the images in the current directory
+ *
+ * Items are processed in the order they have been appended. Thumbnails which
+ * must be generated from the image are created on ThumbnailGenerator's thread
+ * pool, with up to ThumbnailGenerator::maxRunningRequests() of them in flight.
  */
 class GWENVIEWLIB_EXPORT ThumbnailProvider : public KIO::Job
 {
@@ -97,6 +104,17 @@ public:
      */
     static QString thumbnailBaseDir(ThumbnailGroup::Enum group);
 
+    /**
+     * Returns the URI identifying @p url in thumbnails, as stored in their
+     * Thumb::URI key
+     */
+    static QString originalUri(const QUrl &url);
+
+    /**
+     * Returns the path of the thumbnail of @p originalUri for the @p group
+     */
+    static QString thumbnailPath(const QString &originalUri, ThumbnailGroup::Enum group);
+
     /**
      * Delete the thumbnail for the @p url
      */
@@ -113,6 +131,11 @@ public:
      */
     static bool isThumbnailWriterEmpty();
 
+    /**
+     * Blocks until all thumbnails have been written to disk.
+     */
+    static void flushThumbnailWriter();
+
 Q_SIGNALS:
     /**
      * Emitted when the thumbnail for the @p item has been loaded
@@ -133,12 +156,12 @@ private Q_SLOTS:
     void determineNextIcon();
     void slotGotPreview(const KFileItem &, const QPixmap &);
     void checkThumbnail();
-    void thumbnailReady(const QImage &, const QSize &);
     void emitThumbnailLoadingFailed();
 
 private:
     enum {
         STATE_STATORIG,
+        STATE_READHEADER,
         STATE_DOWNLOADORIG,
         STATE_PREVIEWJOB,
         STATE_NEXTTHUMB,
@@ -165,17 +188,32 @@ private:
     // The temporary path for remote urls
     QString mTempPath;
 
+    // The beginning of the remote original, read in STATE_READHEADER
+    QByteArray mHeaderData;
+    // True if mHeaderData contains the whole original
+    bool mHeaderComplete = false;
+
+    // Remote originals whose header did not contain a usable thumbnail, they
+    // must be downloaded
+    QSet<QUrl> mFullDownloadUrls;
+
     // Thumbnail group
     ThumbnailGroup::Enum mThumbnailGroup;
 
-    ThumbnailGenerator *mThumbnailGenerator;
-    QPointer<ThumbnailGenerator> mPreviousThumbnailGenerator;
+    // Thumbnails being generated, in the order they have been started
+    QList<ThumbnailGenerationTask *> mGenerationTasks;
 
     QStringList mPreviewPlugins;
 
-    void createNewThumbnailGenerator();
     void abortSubjob();
+    void createThumbnail();
+    void startReadingHeader();
+    void startDownloadingOriginal();
     void startCreatingThumbnail(const QString &path);
+    void startLoadingCachedThumbnail(ThumbnailResult (*function)(const ThumbnailRequest &));
+    void startGenerationTask(const QString &pixPath, ThumbnailResult (*function)(const ThumbnailRequest &));
+    bool isThumbnailUpToDate(const QString &uri, const QString &mtime, const QString &size) const;
+    void generationTaskFinished(ThumbnailGenerationTask *task);
 
     void emitThumbnailLoaded(const QImage &img, const QSize &size);
 
@@ -26,8 +26,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #include "gwenviewconfig.h"
 
 // Qt
+#include <QCoreApplication>
 #include <QImage>
+#include <QImageWriter>
 #include <QTemporaryFile>
+#include <QtConcurrentMap>
 
 namespace Gwenview
 {
@@ -40,25 +43,55 @@ namespace Gwenview
 #define LOG(x) ;
 #endif
 
-static void storeThumbnailToDiskCache(const QString &path, const QImage &image)
-{
-    if (GwenviewConfig::lowResourceUsageMode()) {
-        return;
-    }
+// Bounds the memory used by thumbnails waiting to be written. That is 32
+// xx-large thumbnails, or a few thousands normal ones.
+static const qint64 MAX_QUEUED_BYTES = 128 * 1024 * 1024;
 
-    LOG(path);
-    QTemporaryFile tmp(path + QStringLiteral(".gwenview.tmpXXXXXX.png"));
+// Number of thumbnails encoded before their files are moved in place
+static const int BATCH_SIZE = 32;
+
+// Producers waiting for room check for interruption this often
+static const int QUEUE_WAIT_TIMEOUT = 100;
+
+Q_GLOBAL_STATIC(ThumbnailWriter, sThumbnailWriter)
+
+struct PendingThumbnail {
+    QString mPath;
+    QImage mImage;
+    // Set once the thumbnail has been successfully encoded
+    QString mTempPath;
+};
+
+static void encodeThumbnail(PendingThumbnail &thumbnail, int compressionLevel)
+{
+    LOG(thumbnail.mPath);
+    QTemporaryFile tmp(thumbnail.mPath + QStringLiteral(".gwenview.tmpXXXXXX.png"));
     if (!tmp.open()) {
         qCWarning(GWENVIEW_LIB_LOG) << "Could not create a temporary file.";
         return;
     }
 
-    if (!image.save(tmp.fileName(), "png")) {
-        qCWarning(GWENVIEW_LIB_LOG) << "Could not save thumbnail";
+    // Thumbnails are usually read many more times than they are written, but
+    // most of the gain in size comes from the first zlib levels while the
+    // cost in time keeps growing
+    QImageWriter writer(&tmp, "png");
+    writer.setCompression(compressionLevel);
+    if (!writer.write(thumbnail.mImage)) {
+        qCWarning(GWENVIEW_LIB_LOG) << "Could not save thumbnail" << writer.errorString();
         return;
     }
+    tmp.setAutoRemove(false);
+    thumbnail.mTempPath = tmp.fileName();
+}
 
-    QFile::rename(tmp.fileName(), path);
+ThumbnailWriter::ThumbnailWriter()
+{
+    mEncoderPool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+ThumbnailWriter *ThumbnailWriter::instance()
+{
+    return sThumbnailWriter;
 }
 
 void ThumbnailWriter::queueThumbnail(const QString &path, const QImage &image)
@@ -69,29 +102,60 @@ void ThumbnailWriter::queueThumbnail(const QString &path, const QImage &image)
 
     LOG(path);
     QMutexLocker locker(&mMutex);
+    // Slow down the threads generating thumbnails when they produce them
+    // faster than we can write them. Never block the GUI thread, nor wait
+    // for a writer which has been asked to stop or is not running: nobody
+    // would make room.
+    if (qApp && QThread::currentThread() != qApp->thread()) {
+        while (mQueuedBytes >= MAX_QUEUED_BYTES && !mCache.contains(path) && isRunning() && !isInterruptionRequested()) {
+            mQueueNotFull.wait(&mMutex, QUEUE_WAIT_TIMEOUT);
+        }
+    }
+    auto it = mCache.find(path);
+    if (it != mCache.end()) {
+        mQueuedBytes -= it->sizeInBytes();
+    }
     mCache.insert(path, image);
+    mQueuedBytes += image.sizeInBytes();
     start();
 }
 
 void ThumbnailWriter::run()
 {
+    const int compressionLevel = qBound(0, GwenviewConfig::thumbnailCompressionLevel(), 9);
     QMutexLocker locker(&mMutex);
     while (!mCache.isEmpty() && !isInterruptionRequested()) {
-        Cache::ConstIterator it = mCache.constBegin();
-        const QString path = it.key();
-        const QImage image = it.value();
-
-        // This part of the thread is the most time consuming but it does not
-        // depend on mCache so we can unlock here. This way other thumbnails
-        // can be added or queried
+        QList<PendingThumbnail> batch;
+        for (auto it = mCache.constBegin(), end = mCache.constEnd(); it != end && batch.size() < BATCH_SIZE; ++it) {
+            batch.append({it.key(), it.value(), QString()});
+        }
+
+        // Encoding is the most time consuming part and does not depend on
+        // mCache so we can unlock here. This way other thumbnails can be added
+        // or queried
         locker.unlock();
-        storeThumbnailToDiskCache(path, image);
+        QtConcurrent::blockingMap(&mEncoderPool, batch, [compressionLevel](PendingThumbnail &thumbnail) {
+            encodeThumbnail(thumbnail, compressionLevel);
+        });
+        for (const PendingThumbnail &thumbnail : qAsConst(batch)) {
+            if (!thumbnail.mTempPath.isEmpty()) {
+                QFile::rename(thumbnail.mTempPath, thumbnail.mPath);
+            }
+        }
         locker.relock();
 
-        mCache.remove(path);
+        for (const PendingThumbnail &thumbnail : qAsConst(batch)) {
+            // The thumbnail may have been queued again while we were writing
+            // it, in which case it must be written again
+            auto it = mCache.find(thumbnail.mPath);
+            if (it != mCache.end() && it->cacheKey() == thumbnail.mImage.cacheKey()) {
+                mQueuedBytes -= it->sizeInBytes();
+                mCache.erase(it);
+            }
+        }
+        mQueueNotFull.wakeAll();
     }
 }
-
 QImage ThumbnailWriter::value(const QString &path) const
 {
     QMutexLocker locker(&mMutex);
@@ -104,6 +168,20 @@ bool ThumbnailWriter::isEmpty() const
     return mCache.isEmpty();
 }
 
+void ThumbnailWriter::flush()
+{
+    while (true) {
+        wait();
+        QMutexLocker locker(&mMutex);
+        if (mCache.isEmpty()) {
+            return;
+        }
+        // run() may have been about to return when the last thumbnails were
+        // queued, in which case their start() call did nothing
+        start();
+    }
+}
+
 } // namespace
 
 #include "moc_thumbnailwriter.cpp"
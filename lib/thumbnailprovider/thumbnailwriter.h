@@ -29,6 +29,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #include <QHash>
 #include <QMutex>
 #include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
 
 class QImage;
 
@@ -36,16 +38,31 @@ namespace Gwenview
 {
 /**
  * Store thumbnails to disk when done generating them
+ *
+ * Thumbnails are encoded in batches, on a pool of threads, and moved to
+ * their final location once the whole batch has been encoded. The memory
+ * used by the queue is bounded: when it is full, queueThumbnail() blocks
+ * until there is room again, unless it is called from the GUI thread.
  */
 class ThumbnailWriter : public QThread
 {
     Q_OBJECT
 public:
+    ThumbnailWriter();
+
+    static ThumbnailWriter *instance();
+
     // Return thumbnail if it has still not been stored
     QImage value(const QString &) const;
 
     bool isEmpty() const;
 
+    /**
+     * Blocks until all queued thumbnails have been written to disk. Must not
+     * be called from the writer thread.
+     */
+    void flush();
+
 public Q_SLOTS:
     void queueThumbnail(const QString &, const QImage &);
 
@@ -55,7 +72,10 @@ protected:
 private:
     using Cache = QHash<QString, QImage>;
     Cache mCache;
+    qint64 mQueuedBytes = 0;
     mutable QMutex mMutex;
+    QWaitCondition mQueueNotFull;
+    QThreadPool mEncoderPool;
 };
 
 } // namespace
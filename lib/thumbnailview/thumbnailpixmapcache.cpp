@@ -0,0 +1,118 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// Self
+#include "thumbnailpixmapcache.h"
+
+// Qt
+#include <QCache>
+#include <QCoreApplication>
+#include <QHash>
+
+namespace Gwenview
+{
+// In kilobytes: enough for a few thousand normal thumbnails, or a few
+// hundred xx-large ones
+static const int CACHE_SIZE = 96 * 1024;
+
+struct ThumbnailPixmapCacheKey {
+    QUrl mUrl;
+    QDateTime mModificationTime;
+    ThumbnailGroup::Enum mGroup;
+
+    bool operator==(const ThumbnailPixmapCacheKey &other) const
+    {
+        return mGroup == other.mGroup && mUrl == other.mUrl && mModificationTime == other.mModificationTime;
+    }
+};
+
+inline size_t qHash(const ThumbnailPixmapCacheKey &key, size_t seed = 0)
+{
+    return qHashMulti(seed, key.mUrl, key.mModificationTime, int(key.mGroup));
+}
+
+struct ThumbnailPixmapCachePrivate {
+    QCache<ThumbnailPixmapCacheKey, ThumbnailPixmapCache::Entry> mCache;
+    // Keys of the thumbnails of each url, so that remove() does not have to
+    // look at the whole cache. May contain keys of evicted thumbnails.
+    QMultiHash<QUrl, ThumbnailPixmapCacheKey> mKeysForUrl;
+
+    void purgeEvictedKeys()
+    {
+        for (auto it = mKeysForUrl.begin(); it != mKeysForUrl.end();) {
+            if (mCache.contains(it.value())) {
+                ++it;
+            } else {
+                it = mKeysForUrl.erase(it);
+            }
+        }
+    }
+};
+
+ThumbnailPixmapCache *ThumbnailPixmapCache::instance()
+{
+    static ThumbnailPixmapCache cache;
+    return &cache;
+}
+
+ThumbnailPixmapCache::ThumbnailPixmapCache()
+    : d(new ThumbnailPixmapCachePrivate)
+{
+    d->mCache.setMaxCost(CACHE_SIZE);
+    if (qApp) {
+        // The cache is a static, it would otherwise destroy its pixmaps after
+        // QApplication
+        QObject::connect(qApp, &QCoreApplication::aboutToQuit, qApp, [this]() {
+            clear();
+        });
+    }
+}
+
+ThumbnailPixmapCache::~ThumbnailPixmapCache()
+{
+    delete d;
+}
+
+bool ThumbnailPixmapCache::find(const QUrl &url, const QDateTime &mtime, ThumbnailGroup::Enum group, Entry *entry)
+{
+    // QCache::object() moves the entry to the front of the LRU list
+    const Entry *cachedEntry = d->mCache.object({url, mtime, group});
+    if (!cachedEntry) {
+        return false;
+    }
+    *entry = *cachedEntry;
+    return true;
+}
+
+void ThumbnailPixmapCache::insert(const QUrl &url, const QDateTime &mtime, ThumbnailGroup::Enum group, const Entry &entry)
+{
+    if (entry.pixmap.isNull()) {
+        return;
+    }
+    const qint64 cost = qMax(qint64(1), qint64(entry.pixmap.width()) * entry.pixmap.height() * entry.pixmap.depth() / 8 / 1024);
+    const ThumbnailPixmapCacheKey key = {url, mtime, group};
+    if (d->mKeysForUrl.size() > 2 * d->mCache.count() + 1024) {
+        d->purgeEvictedKeys();
+    }
+    if (!d->mCache.contains(key)) {
+        d->mKeysForUrl.insert(url, key);
+    }
+    d->mCache.insert(key, new Entry(entry), cost);
+}
+
+void ThumbnailPixmapCache::remove(const QUrl &url)
+{
+    const QList<ThumbnailPixmapCacheKey> keys = d->mKeysForUrl.values(url);
+    for (const ThumbnailPixmapCacheKey &key : keys) {
+        d->mCache.remove(key);
+    }
+    d->mKeysForUrl.remove(url);
+}
+
+void ThumbnailPixmapCache::clear()
+{
+    d->mCache.clear();
+    d->mKeysForUrl.clear();
+}
+
+} // namespace
@@ -0,0 +1,71 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef THUMBNAILPIXMAPCACHE_H
+#define THUMBNAILPIXMAPCACHE_H
+
+#include <lib/gwenviewlib_export.h>
+
+// Qt
+#include <QDateTime>
+#include <QPixmap>
+#include <QSize>
+#include <QUrl>
+
+// KF
+#include <KIO/Global>
+
+// Local
+#include <lib/thumbnailgroup.h>
+
+namespace Gwenview
+{
+struct ThumbnailPixmapCachePrivate;
+
+/**
+ * A process-wide cache of the thumbnails shown by thumbnail views.
+ *
+ * Thumbnail views forget their thumbnails when they leave a folder. Keeping
+ * the most recently shown ones here means going back to a folder, or showing
+ * the same folder in another view, does not have to load them again.
+ *
+ * Thumbnails are keyed by url, modification time and thumbnail group, and
+ * evicted in least recently used order once they use more than a fixed
+ * amount of memory. Must only be used from the GUI thread.
+ */
+class GWENVIEWLIB_EXPORT ThumbnailPixmapCache
+{
+public:
+    struct Entry {
+        QPixmap pixmap;
+        /// Size of the full image, invalid if unknown
+        QSize fullSize;
+        KIO::filesize_t fileSize = 0;
+    };
+
+    static ThumbnailPixmapCache *instance();
+    ~ThumbnailPixmapCache();
+
+    /**
+     * Returns true and fills @p entry if there is a thumbnail for @p url
+     * with modification time @p mtime in @p group
+     */
+    bool find(const QUrl &url, const QDateTime &mtime, ThumbnailGroup::Enum group, Entry *entry);
+
+    void insert(const QUrl &url, const QDateTime &mtime, ThumbnailGroup::Enum group, const Entry &entry);
+
+    /**
+     * Removes all the thumbnails of @p url
+     */
+    void remove(const QUrl &url);
+
+    void clear();
+
+private:
+    ThumbnailPixmapCache();
+    ThumbnailPixmapCachePrivate *const d;
+};
+
+} // namespace
+
+#endif /* THUMBNAILPIXMAPCACHE_H */
@@ -21,6 +21,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 // STL
 #include <cmath>
+#include <functional>
 
 // Qt
 #include <QApplication>
@@ -28,6 +29,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <QDrag>
 #include <QDragEnterEvent>
 #include <QDropEvent>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
 #include <QMimeData>
 #include <QPainter>
 #include <QPointer>
@@ -37,6 +40,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <QTimeLine>
 #include <QTimer>
 #include <QWindow>
+#include <QtConcurrentMap>
 
 // KF
 #include <KDirLister>
@@ -50,6 +54,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "abstractdocumentinfoprovider.h"
 #include "abstractthumbnailviewhelper.h"
 #include "dragpixmapgenerator.h"
+#include "thumbnailpixmapcache.h"
 #include "gwenview_lib_debug.h"
 #include "gwenviewconfig.h"
 #include "mimetypeutils.h"
@@ -76,6 +81,18 @@ const int SMOOTH_DELAY = 500;
 
 const int WHEEL_ZOOM_MULTIPLIER = 4;
 
+/**
+ * How long, in milliseconds, it takes for a scheduled thumbnail to show up.
+ * Used to predict where the viewport will be by then while scrolling.
+ */
+const int THUMBNAIL_LATENCY = 1000;
+
+/**
+ * If no scroll happened for this long, in milliseconds, the view is not
+ * moving anymore.
+ */
+const int SCROLL_IDLE_DELAY = 200;
+
 static KFileItem fileItemForIndex(const QModelIndex &index)
 {
     if (!index.isValid()) {
@@ -92,6 +109,43 @@ static QUrl urlForIndex(const QModelIndex &index)
     return item.isNull() ? QUrl() : item.url();
 }
 
+/**
+ * Scales @p pix, a QPixmap or a QImage, to @p size according to @p scaleMode
+ */
+template<class Pixmap>
+static Pixmap scaleThumbnail(const Pixmap &pix, const QSize &size, ThumbnailView::ThumbnailScaleMode scaleMode, Qt::TransformationMode transformationMode)
+{
+    switch (scaleMode) {
+    case ThumbnailView::ScaleToFit:
+        return pix.scaled(size.width(), size.height(), Qt::KeepAspectRatio, transformationMode);
+    case ThumbnailView::ScaleToSquare: {
+        int minSize = qMin(pix.width(), pix.height());
+        Pixmap pix2 = pix.copy((pix.width() - minSize) / 2, (pix.height() - minSize) / 2, minSize, minSize);
+        return pix2.scaled(size.width(), size.height(), Qt::KeepAspectRatio, transformationMode);
+    }
+    case ThumbnailView::ScaleToHeight:
+        return pix.scaledToHeight(size.height(), transformationMode);
+    case ThumbnailView::ScaleToWidth:
+        return pix.scaledToWidth(size.width(), transformationMode);
+    }
+    // Keep compiler happy
+    Q_ASSERT(0);
+    return {};
+}
+
+/**
+ * A thumbnail being smoothed on a worker thread
+ */
+struct SmoothThumbnailJob {
+    QUrl mUrl;
+    /// Identifies the group pix mImage has been created from
+    qint64 mGroupPixKey;
+    QSize mThumbnailSize;
+    ThumbnailView::ThumbnailScaleMode mScaleMode;
+    /// The group pix, then its smoothed version
+    QImage mImage;
+};
+
 struct Thumbnail {
     Thumbnail(const QPersistentModelIndex &index_, const QDateTime &mtime)
         : mIndex(index_)
@@ -109,6 +163,20 @@ struct Thumbnail {
     {
     }
 
+    /**
+     * Init the thumbnail with a real thumbnail of the image
+     */
+    void initAsThumbnail(const QPixmap &pix, const QSize &fullSize, KIO::filesize_t fileSize)
+    {
+        mGroupPix = pix;
+        mAdjustedPix = QPixmap();
+        int largeGroupSize = ThumbnailGroup::pixelSize(ThumbnailGroup::XLarge);
+        mFullSize = fullSize.isValid() ? fullSize : QSize(largeGroupSize, largeGroupSize);
+        mRealFullSize = fullSize;
+        mWaitingForThumbnail = false;
+        mFileSize = fileSize;
+    }
+
     /**
      * Init the thumbnail based on a icon
      */
@@ -235,6 +303,7 @@ struct ThumbnailViewPrivate {
 
     UrlQueue mSmoothThumbnailQueue;
     QTimer mSmoothThumbnailTimer;
+    QFutureWatcher<SmoothThumbnailJob> mSmoothThumbnailWatcher;
 
     QPixmap mWaitingThumbnail;
     QPointer<ThumbnailProvider> mThumbnailProvider;
@@ -248,6 +317,9 @@ struct ThumbnailViewPrivate {
     QScroller *mScroller;
     Touch *mTouch;
 
+    QElapsedTimer mScrollTimer;
+    qreal mScrollVelocity = 0;
+
     bool loading = false;
 
     void setupBusyAnimation()
@@ -271,12 +343,32 @@ struct ThumbnailViewPrivate {
         }
     }
 
+    ThumbnailGroup::Enum thumbnailGroup() const
+    {
+        return ThumbnailGroup::fromPixelSize(mThumbnailSize.width());
+    }
+
+    /**
+     * Init @p thumbnail with the thumbnail another view, or this one before
+     * leaving the folder, has loaded. Returns false if there is none suitable
+     * for the current thumbnail size.
+     */
+    bool initFromPixmapCache(Thumbnail *thumbnail, const KFileItem &item)
+    {
+        ThumbnailPixmapCache::Entry entry;
+        if (!ThumbnailPixmapCache::instance()->find(item.url(), item.time(KFileItem::ModificationTime), thumbnailGroup(), &entry)) {
+            return false;
+        }
+        thumbnail->initAsThumbnail(entry.pixmap, entry.fullSize, entry.fileSize);
+        return thumbnail->isGroupPixAdaptedForSize(mThumbnailSize.height());
+    }
+
     void updateThumbnailForModifiedDocument(const QModelIndex &index)
     {
         Q_ASSERT(mDocumentInfoProvider);
         KFileItem item = fileItemForIndex(index);
         QUrl url = item.url();
-        ThumbnailGroup::Enum group = ThumbnailGroup::fromPixelSize(mThumbnailSize.width());
+        ThumbnailGroup::Enum group = thumbnailGroup();
         QPixmap pix;
         QSize fullSize;
         mDocumentInfoProvider->thumbnailForDocument(url, group, &pix, &fullSize);
@@ -287,8 +379,7 @@ struct ThumbnailViewPrivate {
     void appendItemsToThumbnailProvider(const KFileItemList &list)
     {
         if (mThumbnailProvider) {
-            ThumbnailGroup::Enum group = ThumbnailGroup::fromPixelSize(mThumbnailSize.width());
-            mThumbnailProvider->setThumbnailGroup(group);
+            mThumbnailProvider->setThumbnailGroup(thumbnailGroup());
             mThumbnailProvider->appendItems(list);
         }
     }
@@ -320,24 +411,127 @@ struct ThumbnailViewPrivate {
         drag->setHotSpot(dragPixmap.hotSpot);
     }
 
-    QPixmap scale(const QPixmap &pix, Qt::TransformationMode transformationMode)
+    /**
+     * Returns true if the view scrolls vertically, false if it scrolls
+     * horizontally
+     */
+    bool scrollsVertically() const
+    {
+        return (q->flow() == QListView::LeftToRight) == q->isWrapping();
+    }
+
+    /**
+     * Horizontal lines go from right to left in RTL layouts, returns -1 in
+     * this case so that coordinates along the scroll axis can be flipped to
+     * keep growing with the row
+     */
+    int scrollAxisSign() const
+    {
+        return !scrollsVertically() && q->isRightToLeft() ? -1 : 1;
+    }
+
+    /**
+     * Returns @p rect moved by @p distance pixels along the scroll axis
+     */
+    QRect translatedAlongScrollAxis(const QRect &rect, int distance) const
+    {
+        return scrollsVertically() ? rect.translated(0, distance) : rect.translated(scrollAxisSign() * distance, 0);
+    }
+
+    /**
+     * Sets @p start and @p end to the extent of @p rect along the scroll axis
+     */
+    void lineRange(const QRect &rect, int *start, int *end) const
+    {
+        if (scrollsVertically()) {
+            *start = rect.top();
+            *end = rect.bottom();
+        } else {
+            const int sign = scrollAxisSign();
+            *start = qMin(sign * rect.left(), sign * rect.right());
+            *end = qMax(sign * rect.left(), sign * rect.right());
+        }
+    }
+
+    /**
+     * Sets @p firstRow and @p lastRow to the range of rows whose items are at
+     * most @p before pixels before the viewport and @p after pixels after it,
+     * along the axis it scrolls on. Items are laid out in model order, one
+     * line after the other, so the range can be found with a binary search on
+     * the layout instead of looking at every row.
+     */
+    void rowRangeForWindow(int before, int after, int *firstRow, int *lastRow) const
+    {
+        const int rowCount = q->model()->rowCount();
+        int windowStart, windowEnd;
+        lineRange(q->viewport()->rect(), &windowStart, &windowEnd);
+        windowStart -= before;
+        windowEnd += after;
+
+        // Returns the first row in [begin, rowCount) for which predicate is
+        // false, predicate must be true for all the rows before it
+        auto partitionPoint = [rowCount](int begin, const std::function<bool(int)> &predicate) {
+            int count = rowCount - begin;
+            while (count > 0) {
+                const int step = count / 2;
+                if (predicate(begin + step)) {
+                    begin += step + 1;
+                    count -= step + 1;
+                } else {
+                    count = step;
+                }
+            }
+            return begin;
+        };
+        auto lineForRow = [this](int row, int *start, int *end) {
+            lineRange(q->visualRect(q->model()->index(row, 0)), start, end);
+        };
+        *firstRow = partitionPoint(0, [&](int row) {
+            int start, end;
+            lineForRow(row, &start, &end);
+            return end < windowStart;
+        });
+        *lastRow = partitionPoint(*firstRow, [&](int row) {
+            int start, end;
+            lineForRow(row, &start, &end);
+            return start <= windowEnd;
+        }) - 1;
+    }
+
+    /**
+     * Called when the content moved by @p distance pixels along the scroll
+     * axis, positive when moving towards the last rows
+     */
+    void updateScrollVelocity(int distance)
     {
-        switch (mScaleMode) {
-        case ThumbnailView::ScaleToFit:
-            return pix.scaled(mThumbnailSize.width(), mThumbnailSize.height(), Qt::KeepAspectRatio, transformationMode);
-        case ThumbnailView::ScaleToSquare: {
-            int minSize = qMin(pix.width(), pix.height());
-            QPixmap pix2 = pix.copy((pix.width() - minSize) / 2, (pix.height() - minSize) / 2, minSize, minSize);
-            return pix2.scaled(mThumbnailSize.width(), mThumbnailSize.height(), Qt::KeepAspectRatio, transformationMode);
+        const qint64 elapsed = mScrollTimer.isValid() ? mScrollTimer.restart() : -1;
+        if (elapsed < 0 || elapsed > SCROLL_IDLE_DELAY) {
+            // Starting to scroll, we cannot tell the speed yet
+            mScrollVelocity = 0;
+            if (elapsed < 0) {
+                mScrollTimer.start();
+            }
+            return;
         }
-        case ThumbnailView::ScaleToHeight:
-            return pix.scaledToHeight(mThumbnailSize.height(), transformationMode);
-        case ThumbnailView::ScaleToWidth:
-            return pix.scaledToWidth(mThumbnailSize.width(), transformationMode);
+        // Smooth the speed out, scroll events do not come at a steady pace
+        const qreal velocity = qreal(distance) / qMax(elapsed, qint64(1));
+        mScrollVelocity = (mScrollVelocity + velocity) / 2;
+    }
+
+    /**
+     * Returns how fast the view is scrolling, in pixels per millisecond
+     */
+    qreal scrollVelocity() const
+    {
+        if (!mScrollTimer.isValid() || mScrollTimer.elapsed() > SCROLL_IDLE_DELAY) {
+            return 0;
         }
-        // Keep compiler happy
-        Q_ASSERT(0);
-        return {};
+        return mScrollVelocity;
+    }
+
+    QPixmap scale(const QPixmap &pix, Qt::TransformationMode transformationMode)
+    {
+        return scaleThumbnail(pix, mThumbnailSize, mScaleMode, transformationMode);
     }
 };
 
@@ -376,7 +570,8 @@ ThumbnailView::ThumbnailView(QWidget *parent)
     connect(&d->mScheduledThumbnailGenerationTimer, &QTimer::timeout, this, &ThumbnailView::generateThumbnailsForItems);
 
     d->mSmoothThumbnailTimer.setSingleShot(true);
-    connect(&d->mSmoothThumbnailTimer, &QTimer::timeout, this, &ThumbnailView::smoothNextThumbnail);
+    connect(&d->mSmoothThumbnailTimer, &QTimer::timeout, this, &ThumbnailView::smoothThumbnails);
+    connect(&d->mSmoothThumbnailWatcher, &QFutureWatcherBase::finished, this, &ThumbnailView::applySmoothedThumbnails);
 
     setContextMenuPolicy(Qt::CustomContextMenu);
     connect(this, &ThumbnailView::customContextMenuRequested, this, &ThumbnailView::showContextMenu);
@@ -484,9 +679,11 @@ void ThumbnailView::updateThumbnailSize()
     d->mWaitingThumbnail = pix;
     d->mWaitingThumbnail.setDevicePixelRatio(dpr);
 
-    // Stop smoothing
+    // Stop smoothing, results which are still on their way are for the
+    // previous size and will be dropped
     d->mSmoothThumbnailTimer.stop();
     d->mSmoothThumbnailQueue.clear();
+    d->mSmoothThumbnailWatcher.cancel();
 
     // Clear adjustedPixes
     ThumbnailForUrl::iterator it = d->mThumbnailForUrl.begin(), end = d->mThumbnailForUrl.end();
@@ -662,13 +859,16 @@ void ThumbnailView::setThumbnail(const KFileItem &item, const QPixmap &pixmap, c
         return;
     }
     Thumbnail &thumbnail = it.value();
-    thumbnail.mGroupPix = pixmap;
-    thumbnail.mAdjustedPix = QPixmap();
-    int largeGroupSize = ThumbnailGroup::pixelSize(ThumbnailGroup::XLarge);
-    thumbnail.mFullSize = size.isValid() ? size : QSize(largeGroupSize, largeGroupSize);
-    thumbnail.mRealFullSize = size;
-    thumbnail.mWaitingForThumbnail = false;
-    thumbnail.mFileSize = fileSize;
+    thumbnail.initAsThumbnail(pixmap, size, fileSize);
+
+    // Share the thumbnail with other views, unless it shows unsaved changes
+    if (!d->mDocumentInfoProvider || !d->mDocumentInfoProvider->isModified(item.url())) {
+        ThumbnailPixmapCache::Entry entry;
+        entry.pixmap = pixmap;
+        entry.fullSize = size;
+        entry.fileSize = fileSize;
+        ThumbnailPixmapCache::instance()->insert(item.url(), item.time(KFileItem::ModificationTime), d->thumbnailGroup(), entry);
+    }
 
     update(thumbnail.mIndex);
     if (d->mScaleMode != ScaleToFit) {
@@ -722,6 +922,11 @@ QPixmap ThumbnailView::thumbnailForIndex(const QModelIndex &index, QSize *fullSi
     }
     Thumbnail &thumbnail = it.value();
 
+    // Another view may already have loaded it
+    if (thumbnail.mWaitingForThumbnail && thumbnail.mGroupPix.isNull()) {
+        d->initFromPixmapCache(&thumbnail, item);
+    }
+
     // If dir or archive, generate a thumbnail from fileitem pixmap
     MimeTypeUtils::Kind kind = MimeTypeUtils::fileItemKind(item);
     if (kind == MimeTypeUtils::KIND_ARCHIVE || kind == MimeTypeUtils::KIND_DIR) {
@@ -964,6 +1169,7 @@ void ThumbnailView::selectionChanged(const QItemSelection &selected, const QItem
 void ThumbnailView::scrollContentsBy(int dx, int dy)
 {
     QListView::scrollContentsBy(dx, dy);
+    d->updateScrollVelocity(d->scrollsVertically() ? -dy : -dx * d->scrollAxisSign());
     d->scheduleThumbnailGeneration();
 }
 
@@ -972,16 +1178,49 @@ void ThumbnailView::generateThumbnailsForItems()
     if (!isVisible() || !model() || d->loading) {
         return;
     }
-    const QRect visibleRect = viewport()->rect();
+    const QRect viewportRect = viewport()->rect();
+    const int screenLength = d->scrollsVertically() ? viewportRect.height() : viewportRect.width();
+
+    // While scrolling, focus on where the viewport will be once the
+    // thumbnails are ready rather than on where it is now
+    const int lead = qBound(-4 * screenLength, qRound(d->scrollVelocity() * THUMBNAIL_LATENCY), 4 * screenLength);
+    const QRect visibleRect = d->translatedAlongScrollAxis(viewportRect, lead);
     const int visibleSurface = visibleRect.width() * visibleRect.height();
     const QPoint origin = visibleRect.center();
-    // Keep thumbnails around that are at most two "screen heights" away.
-    const int discardDistance = visibleRect.bottomRight().manhattanLength() * 2;
+    int visibleStart, visibleEnd;
+    d->lineRange(visibleRect, &visibleStart, &visibleEnd);
+
+    // Keep thumbnails around that are at most two "screen heights" away,
+    // extending the window in the direction of travel.
+    int firstRow, lastRow;
+    d->rowRangeForWindow(2 * screenLength + qMax(-lead, 0), 2 * screenLength + qMax(lead, 0), &firstRow, &lastRow);
+
+    // Discard thumbnails that are too far away to prevent large directories
+    // from consuming massive amounts of RAM. Only items which have been close
+    // to the viewport are in mThumbnailForUrl, so this does not depend on the
+    // number of items either.
+    KFileItemList discardedItems;
+    for (ThumbnailForUrl::Iterator it = d->mThumbnailForUrl.begin(); it != d->mThumbnailForUrl.end();) {
+        const int row = it->mIndex.row();
+        if (it->mIndex.isValid() && row >= firstRow && row <= lastRow) {
+            ++it;
+            continue;
+        }
+        const KFileItem item = fileItemForIndex(it->mIndex);
+        if (!item.isNull()) {
+            discardedItems << item;
+        }
+        d->mSmoothThumbnailQueue.removeAll(it.key());
+        it = d->mThumbnailForUrl.erase(it);
+    }
+    if (d->mThumbnailProvider && !discardedItems.isEmpty()) {
+        d->mThumbnailProvider->removeItems(discardedItems);
+    }
 
     // distance => item
     QMultiMap<int, KFileItem> itemMap;
 
-    for (int row = 0; row < model()->rowCount(); ++row) {
+    for (int row = firstRow; row <= lastRow; ++row) {
         QModelIndex index = model()->index(row, 0);
         KFileItem item = fileItemForIndex(index);
         QUrl url = item.url();
@@ -1011,35 +1250,18 @@ void ThumbnailView::generateThumbnailsForItems()
         if (itemRect.intersected(visibleRect).isValid()) {
             // Item is visible, order thumbnails from left to right, top to bottom
             // Distance is computed so that it is between 0 and visibleSurface
-            distance = itemRect.top() * visibleRect.width() + itemRect.left();
+            distance = (itemRect.top() - visibleRect.top()) * visibleRect.width() + itemRect.left() - visibleRect.left();
             // Make sure directory thumbnails are generated after image thumbnails:
             // Distance is between visibleSurface and 2 * visibleSurface
             if (kind == MimeTypeUtils::KIND_DIR) {
                 distance = distance + visibleSurface;
             }
         } else {
-            // Calculate how far away the thumbnail is to determine if it could
-            // become visible soon.
-            qreal itemDistance = (itemRect.center() - origin).manhattanLength();
-
-            if (itemDistance < discardDistance) {
-                // Item is not visible but within an area that may potentially
-                // become visible soon, order thumbnails according to distance
-                // Start at 2 * visibleSurface to ensure invisible thumbnails are
-                // generated *after* visible thumbnails
-                distance = 2 * visibleSurface + itemDistance;
-            } else {
-                // Discard thumbnails that are too far away to prevent large
-                // directories from consuming massive amounts of RAM.
-                if (it != d->mThumbnailForUrl.constEnd()) {
-                    // Thumbnail exists for this item, discard it.
-                    const QUrl url = item.url();
-                    d->mThumbnailForUrl.remove(url);
-                    d->mSmoothThumbnailQueue.removeAll(url);
-                    d->mThumbnailProvider->removeItems({item});
-                }
-                continue;
-            }
+            // Item is not visible but within an area that may potentially
+            // become visible soon, order thumbnails according to distance
+            // Start at 2 * visibleSurface to ensure invisible thumbnails are
+            // generated *after* visible thumbnails
+            distance = 2 * visibleSurface + (itemRect.center() - origin).manhattanLength();
         }
 
         // Filter out items which already have a thumbnail
@@ -1047,20 +1269,41 @@ void ThumbnailView::generateThumbnailsForItems()
             continue;
         }
 
-        // Add the item to our map
-        itemMap.insert(distance, item);
-
         // Insert the thumbnail in mThumbnailForUrl, so that
         // setThumbnail() can find the item to update
-        if (it == d->mThumbnailForUrl.constEnd()) {
+        ThumbnailForUrl::Iterator thumbnailIt = d->mThumbnailForUrl.find(url);
+        if (thumbnailIt == d->mThumbnailForUrl.end()) {
             Thumbnail thumbnail = Thumbnail(QPersistentModelIndex(index), item.time(KFileItem::ModificationTime));
-            d->mThumbnailForUrl.insert(url, thumbnail);
+            thumbnailIt = d->mThumbnailForUrl.insert(url, thumbnail);
+        }
+
+        // No need to ask the provider if the thumbnail has been loaded before
+        if (d->initFromPixmapCache(&thumbnailIt.value(), item)) {
+            update(index);
+            continue;
         }
+
+        // Do not spend time on items the viewport will have scrolled past by
+        // the time their thumbnails are ready
+        int itemStart, itemEnd;
+        d->lineRange(itemRect, &itemStart, &itemEnd);
+        if ((lead > 0 && itemEnd < visibleStart) || (lead < 0 && itemStart > visibleEnd)) {
+            continue;
+        }
+
+        // Add the item to our map
+        itemMap.insert(distance, item);
     }
 
     if (!itemMap.isEmpty()) {
         d->appendItemsToThumbnailProvider(itemMap.values());
     }
+
+    if (lead != 0) {
+        // Come back once the view has settled, to take care of the items the
+        // prediction skipped
+        d->mScheduledThumbnailGenerationTimer.start();
+    }
 }
 
 void ThumbnailView::updateThumbnail(const QUrl &url)
@@ -1112,9 +1355,11 @@ QPixmap ThumbnailView::busySequenceCurrentPixmap() const
     return d->mBusySequence.frameAt(d->mBusyAnimationTimeLine->currentFrame());
 }
 
-void ThumbnailView::smoothNextThumbnail()
+void ThumbnailView::smoothThumbnails()
 {
-    if (d->mSmoothThumbnailQueue.isEmpty()) {
+    if (d->mSmoothThumbnailQueue.isEmpty() || d->mSmoothThumbnailWatcher.isRunning()) {
+        // applySmoothedThumbnails() comes back here once the running batch
+        // is done
         return;
     }
 
@@ -1124,16 +1369,41 @@ void ThumbnailView::smoothNextThumbnail()
         return;
     }
 
-    QUrl url = d->mSmoothThumbnailQueue.dequeue();
-    ThumbnailForUrl::Iterator it = d->mThumbnailForUrl.find(url);
-    GV_RETURN_IF_FAIL2(it != d->mThumbnailForUrl.end(), url << "not in mThumbnailForUrl.");
-
-    Thumbnail &thumbnail = it.value();
-    thumbnail.mAdjustedPix = d->scale(thumbnail.mGroupPix, Qt::SmoothTransformation);
-    thumbnail.mRough = false;
+    // Smooth all the queued thumbnails at once, on worker threads. QPixmap
+    // cannot be used outside of the GUI thread, so work on QImages.
+    QList<SmoothThumbnailJob> jobs;
+    while (!d->mSmoothThumbnailQueue.isEmpty()) {
+        const QUrl url = d->mSmoothThumbnailQueue.dequeue();
+        ThumbnailForUrl::ConstIterator it = d->mThumbnailForUrl.constFind(url);
+        if (it == d->mThumbnailForUrl.constEnd() || !it->mRough || it->mGroupPix.isNull()) {
+            continue;
+        }
+        jobs.append({url, it->mGroupPix.cacheKey(), d->mThumbnailSize, d->mScaleMode, it->mGroupPix.toImage()});
+    }
+    d->mSmoothThumbnailWatcher.setFuture(QtConcurrent::mapped(jobs, [](SmoothThumbnailJob job) {
+        job.mImage = scaleThumbnail(job.mImage, job.mThumbnailSize, job.mScaleMode, Qt::SmoothTransformation);
+        return job;
+    }));
+}
 
-    GV_RETURN_IF_FAIL2(thumbnail.mIndex.isValid(), "index for" << url << "is invalid.");
-    update(thumbnail.mIndex);
+void ThumbnailView::applySmoothedThumbnails()
+{
+    const QFuture<SmoothThumbnailJob> future = d->mSmoothThumbnailWatcher.future();
+    if (!future.isCanceled()) {
+        const QList<SmoothThumbnailJob> jobs = future.results();
+        for (const SmoothThumbnailJob &job : jobs) {
+            ThumbnailForUrl::Iterator it = d->mThumbnailForUrl.find(job.mUrl);
+            // Drop results for thumbnails which changed in the meantime
+            if (it == d->mThumbnailForUrl.end() || it->mGroupPix.cacheKey() != job.mGroupPixKey || job.mThumbnailSize != d->mThumbnailSize
+                || job.mScaleMode != d->mScaleMode) {
+                continue;
+            }
+            it->mAdjustedPix = QPixmap::fromImage(job.mImage);
+            it->mRough = false;
+        }
+        // One repaint for the whole batch
+        viewport()->update();
+    }
 
     if (!d->mSmoothThumbnailQueue.isEmpty()) {
         d->mSmoothThumbnailTimer.start(0);
@@ -1148,6 +1418,7 @@ void ThumbnailView::reloadThumbnail(const QModelIndex &index)
         return;
     }
     ThumbnailProvider::deleteImageThumbnail(url);
+    ThumbnailPixmapCache::instance()->remove(url);
     ThumbnailForUrl::Iterator it = d->mThumbnailForUrl.find(url);
     if (it == d->mThumbnailForUrl.end()) {
         return;
@@ -207,7 +207,8 @@ private Q_SLOTS:
      */
     void updateBusyIndexes();
 
-    void smoothNextThumbnail();
+    void smoothThumbnails();
+    void applySmoothedThumbnails();
 
 private:
     friend struct ThumbnailViewPrivate;
@@ -34,6 +34,7 @@ namespace TimeUtils
 enum CachePolicy {
     SkipCache,
     UseCache,
+    CacheOnly, ///< Do not read the file, return an invalid date if the date is not cached yet
 };
 
 QDateTime GWENVIEWLIB_EXPORT dateTimeForFileItem(const KFileItem &fileItem, Gwenview::TimeUtils::CachePolicy cachePolicy = UseCache);
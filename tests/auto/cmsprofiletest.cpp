@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 #include "cmsprofiletest.h"
 
 // Local
+#include <lib/cms/cmsdisplaytransform.h>
 #include <lib/cms/cmsprofile.h>
 #include <lib/exiv2imageloader.h>
 #include <testutils.h>
@@ -29,6 +30,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Cambridge, MA 02110-1301, USA
 // KF
 
 // Qt
+#include <QBuffer>
+#include <QColorSpace>
+#include <QtEndian>
 #include <QTest>
 
 QTEST_MAIN(CmsProfileTest)
@@ -64,6 +68,199 @@ void CmsProfileTest::testLoadFromImageData_data()
 }
 #undef NEW_ROW
 
+static QByteArray sRgbIccData()
+{
+    return QColorSpace(QColorSpace::SRgb).iccProfile();
+}
+
+/**
+ * Builds a little endian TIFF file whose first IFD only contains an
+ * InterColorProfile entry holding @p icc, or no entry if @p icc is empty.
+ * The image data itself is not needed to read the profile.
+ */
+static QByteArray createTiffData(const QByteArray &icc, quint16 version = 42)
+{
+    auto append16 = [](QByteArray *data, quint16 value) {
+        const quint16 le = qToLittleEndian(value);
+        data->append(reinterpret_cast<const char *>(&le), 2);
+    };
+    auto append32 = [](QByteArray *data, quint32 value) {
+        const quint32 le = qToLittleEndian(value);
+        data->append(reinterpret_cast<const char *>(&le), 4);
+    };
+    QByteArray data("II");
+    append16(&data, version);
+    append32(&data, 8);
+    const quint16 entryCount = icc.isEmpty() ? 0 : 1;
+    append16(&data, entryCount);
+    if (entryCount) {
+        append16(&data, 34675);
+        append16(&data, 7); // UNDEFINED
+        append32(&data, icc.size());
+        append32(&data, 8 + 2 + 12 + 4);
+    }
+    append32(&data, 0); // No next IFD
+    return data + icc;
+}
+
+/**
+ * Builds an extended WebP file with an ICCP chunk holding @p icc if it is not
+ * empty, followed by a dummy VP8L chunk
+ */
+static QByteArray createWebPData(const QByteArray &icc)
+{
+    auto appendChunk = [](QByteArray *data, const char *fourCC, const QByteArray &content) {
+        const quint32 length = qToLittleEndian(quint32(content.size()));
+        data->append(fourCC, 4);
+        data->append(reinterpret_cast<const char *>(&length), 4);
+        data->append(content);
+        if (content.size() & 1) {
+            data->append('\0');
+        }
+    };
+    QByteArray chunks("WEBP");
+    appendChunk(&chunks, "VP8X", QByteArray(10, '\0'));
+    if (!icc.isEmpty()) {
+        appendChunk(&chunks, "ICCP", icc);
+    }
+    appendChunk(&chunks, "VP8L", QByteArray(16, '\0'));
+
+    const quint32 length = qToLittleEndian(quint32(chunks.size()));
+    return QByteArray("RIFF") + QByteArray(reinterpret_cast<const char *>(&length), 4) + chunks;
+}
+
+/**
+ * Returns @p png with a chunk of type @p type holding @p content inserted
+ * right after the IHDR chunk
+ */
+static QByteArray insertPngChunk(const QByteArray &png, const char *type, const QByteArray &content)
+{
+    const QByteArray typeAndContent = QByteArray(type, 4) + content;
+    quint32 crc = 0xffffffff;
+    for (const char byte : typeAndContent) {
+        crc ^= quint8(byte);
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    crc = qToBigEndian(~crc);
+    const quint32 length = qToBigEndian(quint32(content.size()));
+
+    // Signature (8 bytes) and IHDR chunk (25 bytes)
+    QByteArray data = png.left(33);
+    data.append(reinterpret_cast<const char *>(&length), 4);
+    data.append(typeAndContent);
+    data.append(reinterpret_cast<const char *>(&crc), 4);
+    return data + png.mid(33);
+}
+
+void CmsProfileTest::testLoadFromPngData()
+{
+    QByteArray png;
+    {
+        QImage image(4, 4, QImage::Format_RGB32);
+        image.fill(Qt::red);
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        QVERIFY(image.save(&buffer, "png"));
+    }
+    bool parsed = false;
+    Cms::Profile::Ptr ptr = Cms::Profile::loadFromImageData(png, "png", &parsed);
+    QVERIFY(!ptr);
+    QVERIFY(parsed);
+
+    // Qt derives a color space from gAMA and cHRM chunks when decoding: we
+    // cannot tell the profile without decoding the image
+    auto append32 = [](QByteArray *data, quint32 value) {
+        const quint32 be = qToBigEndian(value);
+        data->append(reinterpret_cast<const char *>(&be), 4);
+    };
+    QByteArray gama;
+    append32(&gama, 45455);
+    QByteArray chrm;
+    for (const quint32 value : {31270, 32900, 64000, 33000, 30000, 60000, 15000, 6000}) {
+        append32(&chrm, value);
+    }
+    const QByteArray taggedPng = insertPngChunk(insertPngChunk(png, "cHRM", chrm), "gAMA", gama);
+    QVERIFY(QImage::fromData(taggedPng, "png").colorSpace().isValid());
+    ptr = Cms::Profile::loadFromImageData(taggedPng, "png", &parsed);
+    QVERIFY(!ptr);
+    QVERIFY(!parsed);
+
+    // Neither can we for files libpng fails to read
+    ptr = Cms::Profile::loadFromImageData(png.left(20), "png", &parsed);
+    QVERIFY(!ptr);
+    QVERIFY(!parsed);
+    ptr = Cms::Profile::loadFromImageData(QByteArray("not a jpeg file"), "jpeg", &parsed);
+    QVERIFY(!ptr);
+    QVERIFY(!parsed);
+}
+
+void CmsProfileTest::testLoadFromTiffData()
+{
+    const QByteArray icc = sRgbIccData();
+    QVERIFY(!icc.isEmpty());
+    bool parsed = false;
+    Cms::Profile::Ptr ptr = Cms::Profile::loadFromImageData(createTiffData(icc), "tiff", &parsed);
+    QVERIFY(ptr);
+    QVERIFY(parsed);
+
+    // No profile: there is no need to decode the image to find out
+    ptr = Cms::Profile::loadFromImageData(createTiffData(QByteArray()), "tiff", &parsed);
+    QVERIFY(!ptr);
+    QVERIFY(parsed);
+
+    // BigTIFF and truncated files cannot be parsed: the profile is unknown
+    ptr = Cms::Profile::loadFromImageData(createTiffData(icc, 43), "tiff", &parsed);
+    QVERIFY(!ptr);
+    QVERIFY(!parsed);
+    ptr = Cms::Profile::loadFromImageData(createTiffData(icc).left(16), "tiff", &parsed);
+    QVERIFY(!ptr);
+    QVERIFY(!parsed);
+}
+
+void CmsProfileTest::testLoadFromWebPData()
+{
+    const QByteArray icc = sRgbIccData();
+    QVERIFY(!icc.isEmpty());
+    bool parsed = false;
+    Cms::Profile::Ptr ptr = Cms::Profile::loadFromImageData(createWebPData(icc), "webp", &parsed);
+    QVERIFY(ptr);
+    QVERIFY(parsed);
+
+    ptr = Cms::Profile::loadFromImageData(createWebPData(QByteArray()), "webp", &parsed);
+    QVERIFY(!ptr);
+    QVERIFY(parsed);
+
+    ptr = Cms::Profile::loadFromImageData(createWebPData(icc).left(40), "webp", &parsed);
+    QVERIFY(!ptr);
+    QVERIFY(!parsed);
+}
+
+void CmsProfileTest::testDisplayTransformCache()
+{
+    // Two instances of the same profile share their transforms
+    const Cms::Profile::Ptr profile1 = Cms::Profile::getSRgbProfile();
+    const Cms::Profile::Ptr profile2 = Cms::Profile::getSRgbProfile();
+    QCOMPARE(profile1->id(), profile2->id());
+
+    const Cms::DisplayTransform::Ptr transform = Cms::DisplayTransform::create(profile1, QImage::Format_RGB32, INTENT_PERCEPTUAL);
+    QVERIFY(transform);
+    QCOMPARE(Cms::DisplayTransform::create(profile2, QImage::Format_RGB32, INTENT_PERCEPTUAL), transform);
+    QVERIFY(Cms::DisplayTransform::create(profile1, QImage::Format_RGB888, INTENT_PERCEPTUAL) != transform);
+
+    // Images large enough to be converted in parallel bands must give the
+    // same result as small ones
+    QImage small(4, 4, QImage::Format_RGB32);
+    small.fill(qRgb(10, 120, 230));
+    QImage large(1024, 1024, QImage::Format_RGB32);
+    large.fill(qRgb(10, 120, 230));
+    transform->apply(&small);
+    transform->apply(&large);
+    QCOMPARE(large.pixel(0, 0), small.pixel(0, 0));
+    QCOMPARE(large.pixel(1023, 1023), small.pixel(0, 0));
+}
+
 #if 0
 
 void CmsProfileTest::testLoadFromExiv2Image()
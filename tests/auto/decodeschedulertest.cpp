@@ -0,0 +1,119 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "decodeschedulertest.h"
+
+// Qt
+#include <QMutex>
+#include <QStringList>
+#include <QTest>
+#include <QThreadPool>
+
+// Local
+#include "../lib/decodescheduler.h"
+
+QTEST_GUILESS_MAIN(DecodeSchedulerTest)
+
+using namespace Gwenview;
+
+void DecodeSchedulerTest::init()
+{
+    // With a single thread, the pool is saturated as soon as one task runs
+    QThreadPool *pool = DecodeScheduler::instance()->threadPool();
+    mMaxThreadCount = pool->maxThreadCount();
+    pool->setMaxThreadCount(1);
+}
+
+void DecodeSchedulerTest::cleanup()
+{
+    // Unblock the pool if the test failed before doing it
+    mGate.release();
+    QThreadPool *pool = DecodeScheduler::instance()->threadPool();
+    QVERIFY(pool->waitForDone(5000));
+    pool->setMaxThreadCount(mMaxThreadCount);
+    mGate.acquire(mGate.available());
+}
+
+void DecodeSchedulerTest::blockPool()
+{
+    DecodeScheduler *scheduler = DecodeScheduler::instance();
+    QCOMPARE(scheduler->runningCount(), 0);
+    scheduler->run(DecodeScheduler::Background, [this]() {
+        mGate.acquire();
+    });
+    QTRY_COMPARE(scheduler->runningCount(), 1);
+}
+
+void DecodeSchedulerTest::testPriorityOrder()
+{
+    blockPool();
+    DecodeScheduler *scheduler = DecodeScheduler::instance();
+
+    QMutex mutex;
+    QStringList order;
+    auto record = [&mutex, &order](const QString &name) {
+        QMutexLocker locker(&mutex);
+        order << name;
+    };
+    // Queued from the least important to the most important class
+    scheduler->run(DecodeScheduler::Background, record, QStringLiteral("background"));
+    scheduler->run(DecodeScheduler::Preload, record, QStringLiteral("preload"));
+    scheduler->run(DecodeScheduler::CompareView, record, QStringLiteral("compare"));
+    QCOMPARE(scheduler->queuedCount(DecodeScheduler::Background), 1);
+    QCOMPARE(scheduler->queuedCount(DecodeScheduler::Preload), 1);
+    QCOMPARE(scheduler->queuedCount(DecodeScheduler::CompareView), 1);
+
+    mGate.release();
+    QVERIFY(scheduler->threadPool()->waitForDone(5000));
+    QCOMPARE(order, QStringList({QStringLiteral("compare"), QStringLiteral("preload"), QStringLiteral("background")}));
+    QCOMPARE(scheduler->queuedCount(DecodeScheduler::Background), 0);
+    QCOMPARE(scheduler->queuedCount(DecodeScheduler::Preload), 0);
+    QCOMPARE(scheduler->queuedCount(DecodeScheduler::CompareView), 0);
+    QCOMPARE(scheduler->runningCount(), 0);
+}
+
+void DecodeSchedulerTest::testClearedTasksAreNotCounted()
+{
+    blockPool();
+    DecodeScheduler *scheduler = DecodeScheduler::instance();
+
+    QAtomicInt runCount;
+    for (int i = 0; i < 3; ++i) {
+        scheduler->run(DecodeScheduler::Preload, [&runCount]() {
+            runCount.ref();
+        });
+    }
+    QCOMPARE(scheduler->queuedCount(DecodeScheduler::Preload), 3);
+
+    // Tasks dropped before they run must not be counted as queued forever
+    scheduler->threadPool()->clear();
+    QCOMPARE(scheduler->queuedCount(DecodeScheduler::Preload), 0);
+
+    mGate.release();
+    QVERIFY(scheduler->threadPool()->waitForDone(5000));
+    QCOMPARE(runCount.loadRelaxed(), 0);
+    QCOMPARE(scheduler->runningCount(), 0);
+}
+
+void DecodeSchedulerTest::testCurrentViewBypassesBusyPool()
+{
+    blockPool();
+    DecodeScheduler *scheduler = DecodeScheduler::instance();
+
+    // Other classes wait for the busy thread...
+    QFuture<void> preloadFuture = scheduler->run(DecodeScheduler::Preload, []() {});
+    // ...but the image being viewed does not
+    QFuture<int> currentFuture = scheduler->run(DecodeScheduler::CurrentView, []() {
+        return 42;
+    });
+    QTRY_VERIFY(currentFuture.isFinished());
+    QCOMPARE(currentFuture.result(), 42);
+    QVERIFY(!preloadFuture.isFinished());
+    QCOMPARE(scheduler->queuedCount(DecodeScheduler::Preload), 1);
+
+    mGate.release();
+    preloadFuture.waitForFinished();
+    QCOMPARE(scheduler->queuedCount(DecodeScheduler::Preload), 0);
+}
+
+#include "moc_decodeschedulertest.cpp"
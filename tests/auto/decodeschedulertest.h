@@ -0,0 +1,30 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef DECODESCHEDULERTEST_H
+#define DECODESCHEDULERTEST_H
+
+// Qt
+#include <QObject>
+#include <QSemaphore>
+
+class DecodeSchedulerTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+    void cleanup();
+    void testPriorityOrder();
+    void testClearedTasksAreNotCounted();
+    void testCurrentViewBypassesBusyPool();
+
+private:
+    /// Occupies the only thread of the pool until mGate is released
+    void blockPool();
+
+    QSemaphore mGate;
+    int mMaxThreadCount = 0;
+};
+
+#endif /* DECODESCHEDULERTEST_H */
@@ -19,11 +19,16 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 // Qt
 #include <QConicalGradient>
+#include <QFile>
 #include <QImage>
 #include <QPainter>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
 #include <QTest>
+#include <QThread>
 
 // KF
+#include <KIO/FileCopyJob>
 #include <KIO/StatJob>
 #include <KJobUiDelegate>
 #include <kio_version.h>
@@ -36,6 +41,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "../lib/document/abstractdocumenteditor.h"
 #include "../lib/document/documentfactory.h"
 #include "../lib/document/documentjob.h"
+#include "../lib/document/imagepyramid.h"
 #include "../lib/imagemetainfomodel.h"
 #include "../lib/imageutils.h"
 #include "../lib/transformimageoperation.h"
@@ -56,6 +62,23 @@ static void waitUntilMetaInfoLoaded(Document::Ptr doc)
     }
 }
 
+/**
+ * Writes a JPEG image of random pixels to @p path: it does not compress well,
+ * so it is large and slow to decode
+ */
+static bool createNoiseJpeg(const QString &path, const QSize &size)
+{
+    QImage noise(size, QImage::Format_RGB32);
+    QRandomGenerator random(42);
+    for (int y = 0; y < noise.height(); ++y) {
+        auto line = reinterpret_cast<QRgb *>(noise.scanLine(y));
+        for (int x = 0; x < noise.width(); ++x) {
+            line[x] = 0xff000000 | random.bounded(0x1000000);
+        }
+    }
+    return noise.save(path, "jpeg", 100);
+}
+
 static bool waitUntilJobIsDone(DocumentJob *job)
 {
     JobWatcher watcher(job);
@@ -179,6 +202,34 @@ void DocumentTest::testLoadTwoPasses()
     QCOMPARE(image, doc->image());
 }
 
+void DocumentTest::testLoadMapped()
+{
+    // Local files are read through a memory mapping, which rawData() returns
+    // without copying it
+    QUrl url = urlForTestFile("test.png");
+    QFile file(url.toLocalFile());
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray expectedData = file.readAll();
+    QImage image;
+    QVERIFY(image.loadFromData(expectedData));
+
+    Document::Ptr doc = DocumentFactory::instance()->load(url);
+    doc->setKeepRawData(true);
+    doc->waitUntilLoaded();
+    QCOMPARE(doc->image(), image);
+    {
+        const QByteArray data = doc->rawData();
+        QCOMPARE(data, expectedData);
+        QCOMPARE(doc->rawData().constData(), data.constData());
+    }
+
+    // Reloading maps the file again
+    doc->reload();
+    doc->waitUntilLoaded();
+    QCOMPARE(doc->rawData(), expectedData);
+    QCOMPARE(doc->image(), image);
+}
+
 void DocumentTest::testLoadEmpty()
 {
     QUrl url = urlForTestFile("empty.png");
@@ -271,6 +322,43 @@ void DocumentTest::testLoadRemote()
     QCOMPARE(image.height(), 100);
 }
 
+void DocumentTest::testLoadRemoteProgressive()
+{
+    QUrl url = setUpRemoteTestDir("test.png");
+    if (!url.isValid()) {
+        QSKIP("Not running this test: failed to setup remote test dir.");
+    }
+
+    // A JPEG large enough to be decoded progressively while it is transferred
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    const QString localPath = tempDir.filePath("progressive.jpg");
+    QVERIFY(createNoiseJpeg(localPath, QSize(2000, 1500)));
+
+    url = url.adjusted(QUrl::StripTrailingSlash);
+    url.setPath(url.path() + '/' + "progressive.jpg");
+    KIO::FileCopyJob *copyJob = KIO::file_copy(QUrl::fromLocalFile(localPath), url);
+    QVERIFY2(copyJob->exec(), qPrintable(copyJob->errorString()));
+
+    Document::Ptr doc = DocumentFactory::instance()->load(url);
+    QSignalSpy loadedSpy(doc.data(), SIGNAL(loaded(QUrl)));
+    // Partial images are only previews of a document still loading
+    bool unexpectedPreview = false;
+    connect(doc.data(), &Document::metaInfoUpdated, this, [document = doc.data(), &unexpectedPreview]() {
+        const QImage preview = document->previewImage();
+        if (!preview.isNull() && (!document->image().isNull() || preview.size() != document->size())) {
+            unexpectedPreview = true;
+        }
+    });
+    doc->waitUntilLoaded();
+
+    QVERIFY(!unexpectedPreview);
+    QCOMPARE(doc->loadingState(), Document::Loaded);
+    QCOMPARE(loadedSpy.count(), 1);
+    QVERIFY(doc->previewImage().isNull());
+    QCOMPARE(doc->image().convertToFormat(QImage::Format_RGB32), QImage(localPath).convertToFormat(QImage::Format_RGB32));
+}
+
 void DocumentTest::testLoadAnimated()
 {
     QUrl srcUrl = urlForTestFile("40frames.gif");
@@ -301,6 +389,33 @@ void DocumentTest::testLoadAnimated()
     QVERIFY2(spy.count() > count, "No imageRectUpdated() signal received after restarting");
 }
 
+void DocumentTest::testPrepareDownSampledWhileLoading()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    const QString path = tempDir.filePath("noise.jpg");
+    QVERIFY(createNoiseJpeg(path, QSize(3000, 2000)));
+    Document::Ptr doc = DocumentFactory::instance()->load(QUrl::fromLocalFile(path));
+    waitUntilMetaInfoLoaded(doc);
+
+    QSignalSpy downSampledImageReadySpy(doc.data(), SIGNAL(downSampledImageReady()));
+    QSignalSpy loadingFailedSpy(doc.data(), SIGNAL(loadingFailed(QUrl)));
+    QSignalSpy loadedSpy(doc.data(), SIGNAL(loaded(QUrl)));
+
+    // Zoom in while the first down sampled image is being decoded: the
+    // decoding is canceled and restarted for the new zoom
+    QVERIFY(!doc->prepareDownSampledImageForZoom(0.1));
+    QVERIFY(!doc->prepareDownSampledImageForZoom(0.2));
+
+    QTRY_VERIFY_WITH_TIMEOUT(!downSampledImageReadySpy.isEmpty() || !loadingFailedSpy.isEmpty(), 10000);
+    QVERIFY(loadingFailedSpy.isEmpty());
+    QVERIFY(loadedSpy.isEmpty());
+    QCOMPARE(doc->downSampledImageForZoom(0.2).size(), QSize(1500, 1000));
+    // Nothing has been kept from the canceled decoding: the smaller zoom falls
+    // back to the image of the last requested one
+    QCOMPARE(doc->downSampledImageForZoom(0.1).size(), QSize(1500, 1000));
+}
+
 void DocumentTest::testPrepareDownSampledAfterFailure()
 {
     QUrl url = urlForTestFile("empty.png");
@@ -387,6 +502,67 @@ void DocumentTest::testMultipleLoads()
     QCOMPARE(doc1.data(), doc2.data());
 }
 
+/**
+ * Checks that down sampled images are accounted for in memoryUsage(), since
+ * DocumentFactory relies on it to decide which documents to evict
+ */
+void DocumentTest::testMemoryUsage()
+{
+    QUrl url = urlForTestFile("orient6.jpg");
+    Document::Ptr doc = DocumentFactory::instance()->load(url);
+    doc->waitUntilLoaded();
+    const qint64 fullImageUsage = doc->memoryUsage();
+    QVERIFY(fullImageUsage >= doc->image().sizeInBytes());
+
+    QSignalSpy downSampledImageReadySpy(doc.data(), SIGNAL(downSampledImageReady()));
+    if (!doc->prepareDownSampledImageForZoom(0.2)) {
+        QVERIFY(downSampledImageReadySpy.wait());
+    }
+    QVERIFY(doc->memoryUsage() > fullImageUsage);
+}
+
+void DocumentTest::testImagePyramid()
+{
+    QImage image(5, 3, QImage::Format_RGB32);
+    image.fill(Qt::black);
+    ImagePyramid pyramid;
+    pyramid.setImage(image);
+    QCOMPARE(pyramid.levelCount(), 4);
+    QCOMPARE(pyramid.levelForZoom(1.), 0);
+    QCOMPARE(pyramid.levelForZoom(0.5), 1);
+    QCOMPARE(pyramid.levelForZoom(0.3), 1);
+    QCOMPARE(pyramid.levelForZoom(0.01), 3);
+
+    QSignalSpy levelReadySpy(&pyramid, SIGNAL(levelReady(int)));
+    QVERIFY(!pyramid.prepareLevel(2));
+    QVERIFY(pyramid.level(2).isNull());
+    while (levelReadySpy.count() < 2) {
+        QVERIFY(levelReadySpy.wait());
+    }
+    QCOMPARE(pyramid.level(1).size(), QSize(3, 2));
+    QCOMPARE(pyramid.level(2).size(), QSize(2, 1));
+
+    // Only the top-left pixel of each level should change
+    image.setPixel(0, 0, qRgb(200, 200, 200));
+    pyramid.updateImageRect(image, QRect(0, 0, 1, 1));
+    QCOMPARE(pyramid.level(1).pixel(0, 0), qRgb(50, 50, 50));
+    QCOMPARE(pyramid.level(1).pixel(1, 0), qRgb(0, 0, 0));
+    QCOMPARE(pyramid.level(2).pixel(0, 0), qRgb(13, 13, 13));
+
+    // Image operations update it from worker threads: the change must only be
+    // applied in the thread of the pyramid
+    image.setPixel(0, 0, qRgb(0, 0, 0));
+    QThread *thread = QThread::create([&pyramid, image]() {
+        pyramid.updateImageRect(image, QRect(0, 0, 1, 1));
+    });
+    thread->start();
+    QVERIFY(thread->wait());
+    delete thread;
+    QCOMPARE(pyramid.level(1).pixel(0, 0), qRgb(50, 50, 50));
+    QTRY_COMPARE(pyramid.level(1).pixel(0, 0), qRgb(0, 0, 0));
+    QCOMPARE(pyramid.level(2).pixel(0, 0), qRgb(0, 0, 0));
+}
+
 void DocumentTest::testSaveAs()
 {
     QUrl url = urlForTestFile("orient6.jpg");
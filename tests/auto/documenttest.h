@@ -105,16 +105,21 @@ private Q_SLOTS:
     void testLoad();
     void testLoad_data();
     void testLoadTwoPasses();
+    void testLoadMapped();
     void testLoadEmpty();
     void testLoadDownSampled();
     void testLoadDownSampled_data();
     void testLoadDownSampledPng();
     void testLoadRemote();
+    void testLoadRemoteProgressive();
     void testLoadAnimated();
+    void testPrepareDownSampledWhileLoading();
     void testPrepareDownSampledAfterFailure();
     void testDeleteWhileLoading();
     void testLoadRotated();
     void testMultipleLoads();
+    void testMemoryUsage();
+    void testImagePyramid();
     void testSaveAs();
     void testSaveRemote();
     void testLosslessSave();
@@ -25,11 +25,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <lib/semanticinfo/sorteddirmodel.h>
 
 // Qt
+#include <QStandardPaths>
 #include <QTemporaryDir>
 #include <QTest>
 
 // KF
 #include <KDirLister>
+#include <KDirModel>
 
 using namespace Gwenview;
 
@@ -37,6 +39,9 @@ QTEST_MAIN(SortedDirModelTest)
 
 void SortedDirModelTest::initTestCase()
 {
+    // Do not write metadata indexes to the user cache
+    QStandardPaths::setTestModeEnabled(true);
+
     mSandBoxDir.mkdir("empty_dir");
     mSandBoxDir.mkdir("dirs_only");
     mSandBoxDir.mkdir("dirs_only/dir1");
@@ -74,4 +79,38 @@ void SortedDirModelTest::testHasDocuments()
     QCOMPARE(model.hasDocuments(), hasDocuments);
 }
 
+static void setModificationTime(const QString &path, const QDateTime &dateTime)
+{
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.setFileTime(dateTime, QFileDevice::FileModificationTime));
+}
+
+void SortedDirModelTest::testSortByDate()
+{
+    // Give the files modification times in the opposite order of their Exif
+    // dates
+    mSandBoxDir.mkdir("dates");
+    const QString olderPath = mSandBoxDir.absoluteFilePath("dates/older.jpg");
+    const QString newerPath = mSandBoxDir.absoluteFilePath("dates/newer.jpg");
+    QVERIFY(QFile::copy(pathForTestFile("date/exif-datetimeoriginal.jpg"), olderPath));
+    QVERIFY(QFile::copy(pathForTestFile("date/exif-datetime-only.jpg"), newerPath));
+    setModificationTime(olderPath, QDateTime(QDate(2020, 1, 1), QTime(12, 0)));
+    setModificationTime(newerPath, QDateTime(QDate(2010, 1, 1), QTime(12, 0)));
+
+    SortedDirModel model;
+    model.sort(KDirModel::ModifiedTime, Qt::AscendingOrder);
+    QEventLoop loop;
+    connect(model.dirLister(), SIGNAL(completed()), &loop, SLOT(quit()));
+    model.dirLister()->openUrl(QUrl::fromLocalFile(mSandBoxDir.absoluteFilePath("dates")));
+    loop.exec();
+    QCOMPARE(model.rowCount(), 2);
+
+    // Exif dates are read in the background, once they are known the model
+    // is sorted on them
+    QTRY_COMPARE(model.urlForIndex(model.index(0, 0)).fileName(), QStringLiteral("older.jpg"));
+    const QModelIndex sourceIndex = model.mapToSource(model.index(0, 0));
+    QCOMPARE(model.dateTimeForSourceIndex(sourceIndex), QDateTime::fromString("2003-03-10T17:45:21", Qt::ISODate));
+}
+
 #include "moc_sorteddirmodeltest.cpp"
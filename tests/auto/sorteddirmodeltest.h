@@ -37,6 +37,7 @@ private Q_SLOTS:
     void initTestCase();
     void testHasDocuments_data();
     void testHasDocuments();
+    void testSortByDate();
 
 private:
     TestUtils::SandBoxDir mSandBoxDir;
@@ -20,11 +20,14 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "thumbnailprovidertest.h"
 
 // Qt
+#include <QBuffer>
 #include <QDebug>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QImage>
 #include <QPainter>
+#include <QScopeGuard>
 #include <QTest>
 
 // KF
@@ -32,6 +35,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <KIO/DeleteJob>
 
 // Local
+#include "../lib/thumbnailprovider/pngtextreader.h"
+#include "../lib/thumbnailprovider/thumbnailpackstore.h"
 #include "../lib/thumbnailprovider/thumbnailprovider.h"
 #include "gwenviewconfig.h"
 #include "testutils.h"
@@ -234,6 +239,75 @@ void ThumbnailProviderTest::testUseEmbeddedOrNot()
     }
 }
 
+void ThumbnailProviderTest::testGenerateAllGroups()
+{
+    if (GwenviewConfig::lowResourceUsageMode()) {
+        QSKIP("Thumbnails are not stored in low resource usage mode");
+    }
+    const bool generateAllThumbnailSizes = GwenviewConfig::generateAllThumbnailSizes();
+    GwenviewConfig::setGenerateAllThumbnailSizes(true);
+    const auto restoreConfig = qScopeGuard([generateAllThumbnailSizes]() {
+        GwenviewConfig::setGenerateAllThumbnailSizes(generateAllThumbnailSizes);
+    });
+
+    // 300x200, large enough to need normal and large thumbnails but not
+    // x-large ones
+    const QUrl url = QUrl::fromLocalFile(mSandBox.mPath + "/red.png");
+
+    {
+        ThumbnailProvider provider;
+        provider.setThumbnailGroup(ThumbnailGroup::Large);
+        provider.appendItems({KFileItem(url)});
+        syncRun(&provider);
+        ThumbnailProvider::flushThumbnailWriter();
+    }
+
+    const QString uri = ThumbnailProvider::originalUri(url);
+    QImage thumb;
+    QVERIFY(thumb.load(ThumbnailProvider::thumbnailPath(uri, ThumbnailGroup::Normal)));
+    QCOMPARE(thumb.size(), QSize(128, 85));
+    QVERIFY(thumb.load(ThumbnailProvider::thumbnailPath(uri, ThumbnailGroup::Large)));
+    QCOMPARE(thumb.size(), QSize(256, 170));
+    QCOMPARE(thumb.text("Thumb::Image::Width"), QString("300"));
+    QVERIFY(!QFile::exists(ThumbnailProvider::thumbnailPath(uri, ThumbnailGroup::XLarge)));
+
+    // Asking for a normal thumbnail produces the larger ones too
+    const QUrl blueUrl = QUrl::fromLocalFile(mSandBox.mPath + "/blue.png");
+    {
+        ThumbnailProvider provider;
+        provider.setThumbnailGroup(ThumbnailGroup::Normal);
+        provider.appendItems({KFileItem(blueUrl)});
+        syncRun(&provider);
+        ThumbnailProvider::flushThumbnailWriter();
+    }
+    const QString blueUri = ThumbnailProvider::originalUri(blueUrl);
+    QVERIFY(thumb.load(ThumbnailProvider::thumbnailPath(blueUri, ThumbnailGroup::Normal)));
+    QCOMPARE(thumb.size(), QSize(85, 128));
+    QVERIFY(thumb.load(ThumbnailProvider::thumbnailPath(blueUri, ThumbnailGroup::Large)));
+    QCOMPARE(thumb.size(), QSize(170, 256));
+
+    // Remove the normal thumbnail and replace the original with garbage of the
+    // same size and time: the normal thumbnail must be scaled down from the
+    // large one
+    QVERIFY(QFile::remove(ThumbnailProvider::thumbnailPath(uri, ThumbnailGroup::Normal)));
+    const QFileInfo info(url.toLocalFile());
+    const QDateTime mtime = info.lastModified();
+    {
+        QFile file(url.toLocalFile());
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        file.write(QByteArray(info.size(), 'x'));
+        file.flush();
+        QVERIFY(file.setFileTime(mtime, QFileDevice::FileModificationTime));
+    }
+    ThumbnailProvider provider;
+    provider.setThumbnailGroup(ThumbnailGroup::Normal);
+    provider.appendItems({KFileItem(url)});
+    QSignalSpy spy(&provider, SIGNAL(thumbnailLoaded(KFileItem, QPixmap, QSize, qulonglong)));
+    syncRun(&provider);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(qvariant_cast<QPixmap>(spy.at(0).at(1)).size(), QSize(128, 85));
+}
+
 void ThumbnailProviderTest::testLoadRemote()
 {
     QUrl url = setUpRemoteTestDir("test.png");
@@ -285,4 +359,88 @@ void ThumbnailProviderTest::testRemoveItemsWhileGenerating()
     loop.exec();
 }
 
+void ThumbnailProviderTest::testPngTextReader()
+{
+    QImage image = createColoredImage(16, 16, Qt::red);
+    // Long values end up in compressed zTXt chunks, short ones in tEXt chunks
+    const QString uri = "file://" + mSandBox.mPath + "/a/rather/long/path/to/make/sure/the/value/gets/compressed.png";
+    image.setText("Thumb::URI", uri);
+    image.setText("Thumb::MTime", "1234");
+    const QString path = mSandBox.mPath + "/text.png";
+    QVERIFY(image.save(path, "png"));
+
+    PngTextReader::TextHash texts;
+    QVERIFY(PngTextReader::read(path, &texts));
+    QCOMPARE(texts.value("Thumb::URI"), uri);
+    QCOMPARE(texts.value("Thumb::MTime"), QString("1234"));
+
+    // Not a PNG file
+    texts.clear();
+    QVERIFY(!PngTextReader::read(mSandBox.mPath + "/orient6.jpg", &texts));
+
+    // Truncated file
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray data = file.read(file.size() / 2);
+    file.close();
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    QVERIFY(!PngTextReader::read(&buffer, &texts));
+}
+
+void ThumbnailProviderTest::testThumbnailPacks()
+{
+    if (GwenviewConfig::lowResourceUsageMode()) {
+        QSKIP("Thumbnails are not stored in low resource usage mode");
+    }
+    GwenviewConfig::setThumbnailPacks(true);
+
+    KFileItemList list;
+    for (const QString &name : {QStringLiteral("red.png"), QStringLiteral("blue.png")}) {
+        list << KFileItem(QUrl::fromLocalFile(mSandBox.mPath + '/' + name));
+    }
+
+    // Generate the thumbnails, they are stored in the freedesktop.org cache
+    // and in the pack
+    {
+        ThumbnailProvider provider;
+        provider.setThumbnailGroup(ThumbnailGroup::Normal);
+        provider.appendItems(list);
+        syncRun(&provider);
+        while (!ThumbnailProvider::isThumbnailWriterEmpty()) {
+            QTest::qWait(100);
+        }
+    }
+    ThumbnailPackStore::instance()->save();
+
+    // Remove the freedesktop.org thumbnails, they must now come from the pack
+    QDir thumbnailDir = ThumbnailProvider::thumbnailBaseDir(ThumbnailGroup::Normal);
+    const QStringList entryList = thumbnailDir.entryList(QStringList("*.png"));
+    QCOMPARE(entryList.count(), list.count());
+    for (const QString &name : entryList) {
+        QVERIFY(thumbnailDir.remove(name));
+    }
+
+    {
+        ThumbnailProvider provider;
+        provider.setThumbnailGroup(ThumbnailGroup::Normal);
+        provider.appendItems(list);
+        QSignalSpy spy(&provider, SIGNAL(thumbnailLoaded(KFileItem, QPixmap, QSize, qulonglong)));
+        syncRun(&provider);
+        QCOMPARE(spy.count(), list.count());
+        for (const QVariantList &args : qAsConst(spy)) {
+            const KFileItem item = qvariant_cast<KFileItem>(args.at(0));
+            QCOMPARE(args.at(2).toSize(), mSandBox.mSizeHash.value(item.url().fileName()));
+        }
+    }
+    // Nothing has been generated again
+    while (!ThumbnailProvider::isThumbnailWriterEmpty()) {
+        QTest::qWait(100);
+    }
+    QVERIFY(thumbnailDir.entryList(QStringList("*.png")).isEmpty());
+
+    GwenviewConfig::setThumbnailPacks(false);
+}
+
 #include "moc_thumbnailprovidertest.cpp"
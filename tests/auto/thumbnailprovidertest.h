@@ -49,7 +49,10 @@ private Q_SLOTS:
     void testLoadLocal();
     void testLoadRemote();
     void testUseEmbeddedOrNot();
+    void testGenerateAllGroups();
     void testRemoveItemsWhileGenerating();
+    void testPngTextReader();
+    void testThumbnailPacks();
 
 private:
     SandBox mSandBox;
@@ -24,6 +24,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <utime.h>
 
 // Qt
+#include <QStandardPaths>
 #include <QTemporaryFile>
 #include <QTest>
 
@@ -31,6 +32,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <KFileItem>
 
 // Local
+#include "../lib/metadataindex.h"
 #include "../lib/timeutils.h"
 
 #include "testutils.h"
@@ -44,6 +46,12 @@ static void touchFile(const QString &path)
     utime(QFile::encodeName(path).data(), nullptr);
 }
 
+void TimeUtilsTest::initTestCase()
+{
+    // Do not write metadata indexes to the user cache
+    QStandardPaths::setTestModeEnabled(true);
+}
+
 #define NEW_ROW(fileName, dateTime) QTest::newRow(fileName) << fileName << dateTime
 void TimeUtilsTest::testBasic_data()
 {
@@ -93,4 +101,31 @@ void TimeUtilsTest::testCache()
     QCOMPARE(dateTime2, item2.time(KFileItem::ModificationTime));
 }
 
+void TimeUtilsTest::testMetaDataIndex()
+{
+    QUrl url = urlForTestFile("orient6.jpg");
+    KFileItem item(url);
+
+    const MetaDataIndex::Entry entry = MetaDataIndex::instance()->entryForFileItem(item);
+    QCOMPARE(entry.fileMTime, item.time(KFileItem::ModificationTime));
+    QCOMPARE(entry.fileSize, item.size());
+    QCOMPARE(entry.orientation, 6);
+    QVERIFY(entry.size.isValid());
+
+    const MetaDataIndex::Entry skipCacheEntry = MetaDataIndex::readEntry(item);
+    QCOMPARE(entry.dateTime, skipCacheEntry.dateTime);
+    QCOMPARE(entry.size, skipCacheEntry.size);
+
+    // Write the index to disk and read it back: findEntry() never parses the
+    // file, so it only succeeds if the entry has been persisted
+    MetaDataIndex::instance()->unload();
+    MetaDataIndex::Entry loadedEntry;
+    QVERIFY(MetaDataIndex::instance()->findEntry(item, &loadedEntry));
+    QCOMPARE(loadedEntry.fileMTime, entry.fileMTime);
+    QCOMPARE(loadedEntry.fileSize, entry.fileSize);
+    QCOMPARE(loadedEntry.dateTime, entry.dateTime);
+    QCOMPARE(loadedEntry.orientation, entry.orientation);
+    QCOMPARE(loadedEntry.size, entry.size);
+}
+
 #include "moc_timeutilstest.cpp"
@@ -0,0 +1,257 @@
+// SPDX-FileCopyrightText: 2026 Gwenview developers
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+// STL
+#include <algorithm>
+#include <numeric>
+
+// Qt
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMimeDatabase>
+#include <QMutex>
+#include <QScopedPointer>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QUrl>
+
+// KF
+#include <KAboutData>
+#include <KLocalizedString>
+
+// Local
+#include "gwenview_thumbnailer_debug.h"
+#include <lib/about.h>
+#include <lib/gwenviewconfig.h>
+#include <lib/mimetypeutils.h>
+#include <lib/thumbnailprovider/pngtextreader.h>
+#include <lib/thumbnailprovider/thumbnailgenerator.h>
+#include <lib/thumbnailprovider/thumbnailpackstore.h>
+#include <lib/thumbnailprovider/thumbnailprovider.h>
+
+using namespace Gwenview;
+
+namespace
+{
+struct Statistics {
+    QMutex mMutex;
+    int mGenerated = 0;
+    int mUpToDate = 0;
+    int mFailed = 0;
+    int mThumbnails = 0;
+    // Time spent generating the thumbnails of each file, in microseconds
+    QList<qint64> mLatencies;
+};
+
+bool parseGroups(const QString &string, QList<ThumbnailGroup::Enum> *groups)
+{
+    const QStringList names = string.split(QLatin1Char(','), Qt::SkipEmptyParts);
+    for (const QString &name : names) {
+        if (name == QLatin1String("normal")) {
+            *groups << ThumbnailGroup::Normal;
+        } else if (name == QLatin1String("large")) {
+            *groups << ThumbnailGroup::Large;
+        } else if (name == QLatin1String("x-large")) {
+            *groups << ThumbnailGroup::XLarge;
+        } else if (name == QLatin1String("xx-large")) {
+            *groups << ThumbnailGroup::XXLarge;
+        } else {
+            return false;
+        }
+    }
+    std::sort(groups->begin(), groups->end());
+    groups->erase(std::unique(groups->begin(), groups->end()), groups->end());
+    return !groups->isEmpty();
+}
+
+bool isThumbnailUpToDate(const QString &thumbnailPath, const QString &uri, qint64 mtime)
+{
+    PngTextReader::TextHash texts;
+    if (!PngTextReader::read(thumbnailPath, &texts)) {
+        return false;
+    }
+    return texts.value(QStringLiteral("Thumb::URI")) == uri && texts.value(QStringLiteral("Thumb::MTime")).toLongLong() == mtime;
+}
+
+void generateThumbnails(const QString &path, const QList<ThumbnailGroup::Enum> &groups, Statistics *statistics)
+{
+    const QFileInfo info(path);
+    ThumbnailRequest request;
+    request.originalUri = ThumbnailProvider::originalUri(QUrl::fromLocalFile(path));
+    request.originalTime = info.lastModified().toSecsSinceEpoch();
+    request.originalFileSize = info.size();
+    request.pixPath = path;
+
+    // Only produce the sizes which are missing or out of date
+    QList<ThumbnailGroup::Enum> missingGroups;
+    for (ThumbnailGroup::Enum group : groups) {
+        if (!isThumbnailUpToDate(ThumbnailProvider::thumbnailPath(request.originalUri, group), request.originalUri, request.originalTime)) {
+            missingGroups << group;
+        }
+    }
+    if (missingGroups.isEmpty()) {
+        QMutexLocker locker(&statistics->mMutex);
+        ++statistics->mUpToDate;
+        return;
+    }
+
+    // Groups are sorted: decode once for the largest one, the others are
+    // scaled down from it
+    request.group = missingGroups.constLast();
+    request.thumbnailPath = ThumbnailProvider::thumbnailPath(request.originalUri, request.group);
+    request.originalMimeType = QMimeDatabase().mimeTypeForFile(path).name();
+
+    QElapsedTimer chrono;
+    chrono.start();
+    const ThumbnailResult result = ThumbnailGenerator::generateGroups(request, missingGroups);
+    const qint64 latency = chrono.nsecsElapsed() / 1000;
+
+    QMutexLocker locker(&statistics->mMutex);
+    if (result.image.isNull()) {
+        ++statistics->mFailed;
+        return;
+    }
+    ++statistics->mGenerated;
+    statistics->mThumbnails += missingGroups.size();
+    statistics->mLatencies << latency;
+}
+
+bool isRasterImage(const QString &path)
+{
+    static const QMimeDatabase db;
+    return MimeTypeUtils::mimeTypeKind(db.mimeTypeForFile(path).name()) == MimeTypeUtils::KIND_RASTER_IMAGE;
+}
+
+void printStatistics(Statistics *statistics, qint64 elapsed)
+{
+    QTextStream out(stdout);
+    QList<qint64> &latencies = statistics->mLatencies;
+    std::sort(latencies.begin(), latencies.end());
+    const int count = statistics->mGenerated + statistics->mUpToDate + statistics->mFailed;
+
+    out << i18n("Files: %1 (%2 generated, %3 up to date, %4 failed)", count, statistics->mGenerated, statistics->mUpToDate, statistics->mFailed) << '\n';
+    out << i18n("Thumbnails written: %1", statistics->mThumbnails) << '\n';
+    out << i18n("Total time: %1 s", QString::number(elapsed / 1000., 'f', 1)) << '\n';
+    if (elapsed > 0) {
+        out << i18n("Throughput: %1 files/s", QString::number(statistics->mGenerated * 1000. / elapsed, 'f', 1)) << '\n';
+    }
+    if (!latencies.isEmpty()) {
+        auto ms = [](qint64 usecs) {
+            return QString::number(usecs / 1000., 'f', 1);
+        };
+        const qint64 total = std::accumulate(latencies.constBegin(), latencies.constEnd(), qint64(0));
+        out << i18n("Latency per file: mean %1 ms, median %2 ms, 95th percentile %3 ms, max %4 ms",
+                    ms(total / latencies.size()),
+                    ms(latencies.at(latencies.size() / 2)),
+                    ms(latencies.at(latencies.size() * 95 / 100)),
+                    ms(latencies.constLast()))
+            << '\n';
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    KLocalizedString::setApplicationDomain("gwenview");
+    QCoreApplication app(argc, argv);
+    QScopedPointer<KAboutData> aboutData(Gwenview::createAboutData(QStringLiteral("gwenview_thumbnailer"), /* component name */
+                                                                   i18n("Gwenview Thumbnailer") /* programName */
+                                                                   ));
+    aboutData->setShortDescription(i18n("Generates the thumbnails of image folders ahead of browsing them"));
+
+    KAboutData::setApplicationData(*aboutData);
+
+    QCommandLineParser parser;
+    aboutData->setupCommandLine(&parser);
+    parser.addPositionalArgument(QStringLiteral("folders"), i18n("Folders to generate thumbnails for, including their subfolders"), i18n("folder..."));
+    parser.addOption(QCommandLineOption({QStringLiteral("t"), QStringLiteral("thumbnail-dir")},
+                                        i18n("Store thumbnails in <dir> instead of the default thumbnail cache"),
+                                        QStringLiteral("dir")));
+    parser.addOption(QCommandLineOption({QStringLiteral("s"), QStringLiteral("sizes")},
+                                        i18n("Comma separated list of sizes to generate, among normal, large, x-large and xx-large. Defaults to all of them."),
+                                        QStringLiteral("sizes"),
+                                        QStringLiteral("normal,large,x-large,xx-large")));
+    parser.addOption(QCommandLineOption({QStringLiteral("j"), QStringLiteral("jobs")},
+                                        i18n("Number of files to process in parallel. Defaults to the number of CPU cores."),
+                                        QStringLiteral("count"),
+                                        QString::number(QThread::idealThreadCount())));
+    parser.process(app);
+    aboutData->processCommandLine(&parser);
+
+    const QStringList folders = parser.positionalArguments();
+    if (folders.isEmpty()) {
+        qCWarning(GWENVIEW_THUMBNAILER_LOG) << i18n("Missing required folder argument.");
+        parser.showHelp(1);
+    }
+    QList<ThumbnailGroup::Enum> groups;
+    if (!parseGroups(parser.value(QStringLiteral("sizes")), &groups)) {
+        qCCritical(GWENVIEW_THUMBNAILER_LOG) << i18n("Invalid thumbnail sizes: %1", parser.value(QStringLiteral("sizes")));
+        return 1;
+    }
+    bool ok;
+    const int jobs = parser.value(QStringLiteral("jobs")).toInt(&ok);
+    if (!ok || jobs < 1) {
+        qCCritical(GWENVIEW_THUMBNAILER_LOG) << i18n("Invalid number of jobs: %1", parser.value(QStringLiteral("jobs")));
+        return 1;
+    }
+
+    QString thumbnailBaseDir = parser.value(QStringLiteral("thumbnail-dir"));
+    if (!thumbnailBaseDir.isEmpty()) {
+        thumbnailBaseDir = QDir(thumbnailBaseDir).absolutePath();
+        if (!thumbnailBaseDir.endsWith(QLatin1Char('/'))) {
+            thumbnailBaseDir += QLatin1Char('/');
+        }
+        ThumbnailProvider::setThumbnailBaseDir(thumbnailBaseDir);
+    }
+    for (ThumbnailGroup::Enum group : qAsConst(groups)) {
+        const QString dir = ThumbnailProvider::thumbnailBaseDir(group);
+        if (!QDir().mkpath(dir)) {
+            qCCritical(GWENVIEW_THUMBNAILER_LOG) << i18n("Could not create %1", dir);
+            return 1;
+        }
+        QFile::setPermissions(dir, QFileDevice::WriteOwner | QFileDevice::ReadOwner | QFileDevice::ExeOwner);
+    }
+
+    // Thumbnails are not written to disk in low resource mode, but
+    // writing them is the whole point of running this tool
+    GwenviewConfig::setLowResourceUsageMode(false);
+
+    Statistics statistics;
+    QThreadPool pool;
+    pool.setMaxThreadCount(jobs);
+
+    QElapsedTimer chrono;
+    chrono.start();
+    // Files are handed to the pool as they are found, so that generating
+    // thumbnails starts without waiting for large trees to be listed
+    for (const QString &folder : folders) {
+        QDirIterator it(folder, QDir::Files | QDir::Readable, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            const QString path = it.next();
+            if (path.startsWith(ThumbnailProvider::thumbnailBaseDir()) || !isRasterImage(path)) {
+                continue;
+            }
+            pool.start([path, &groups, &statistics]() {
+                generateThumbnails(path, groups, &statistics);
+            });
+        }
+    }
+    pool.waitForDone();
+
+    // Thumbnails are written in the background, wait for the last ones
+    ThumbnailProvider::flushThumbnailWriter();
+    if (ThumbnailPackStore::isEnabled()) {
+        ThumbnailPackStore::instance()->save();
+    }
+
+    printStatistics(&statistics, chrono.elapsed());
+    return statistics.mFailed > 0 ? 2 : 0;
+}